@@ -1,169 +1,238 @@
 #include "util.h"
-#include <concepts>
-#include <vector>
-#include <fmt/color.h>
+#include <algorithm>
+#include <array>
+#include <charconv>
 #include <fmt/core.h>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
 
-namespace CommandLineArguments {
-
-struct ArgumentBase {
-  public:
-    bool empty{true};
-    std::string_view name{};
-    std::string_view description{};
-    std::string_view briefDescription{};
+#pragma once
 
-    constexpr virtual ~ArgumentBase() = default;
-    constexpr ArgumentBase() = default;
-    constexpr ArgumentBase(const ArgumentBase &) = default;
-};
+namespace CommandLineArguments {
 
 /**
- * @brief The container type for static command line arguments
+ * @brief A command line argument the program accepts
  */
-template <typename Type> struct Argument : public ArgumentBase {
-    Type value{};
-    bool set{};
+struct Option {
+    std::string_view name;
+    std::string_view valueNames{};  //!< The values that follow the name as they are shown in the usage, such as '<item name> <amount>'
+    std::string_view description{};
+    size_t values{};   //!< The amount of values that follow the name, one for every word of valueNames that starts with '<'
+    bool repeatable{}; //!< If the option may be given more than once, see ArgumentParser::forEach()
+
+    constexpr Option(std::string_view name, std::string_view description) : name{name}, description{description} {}
 
-    constexpr Argument() = default;
-    constexpr Argument(std::string_view name, std::string_view description) {
-        this->name = name;
-        this->description = description;
+    constexpr Option(std::string_view name, std::string_view valueNames, std::string_view description) : name{name}, valueNames{valueNames}, description{description} {
+        for (size_t i{}; i < valueNames.size(); i++)
+            if (valueNames[i] == '<' && (!i || valueNames[i - 1] == ' '))
+                values++;
     }
 
-    constexpr Argument(std::string_view name, std::string_view briefDescription, std::string_view description) {
-        this->name = name;
-        this->briefDescription = briefDescription;
-        this->description = description;
+    /**
+     * @brief Allow the option to be given more than once
+     */
+    constexpr Option repeated() const {
+        auto option{*this};
+        option.repeatable = true;
+        return option;
     }
 };
 
 /**
- * @brief A command line argument parser
+ * @brief All options of a program, built at compile time so resolving an option by its name costs nothing at runtime
  */
-class ArgumentParser {
+template <size_t N> class Schema {
+  public:
+    std::array<Option, N> options;
+
   private:
-    const std::vector<std::string_view> rawArguments;     //!< The arguments passed to the program
-    std::vector<std::shared_ptr<ArgumentBase>> arguments; //!< The container with all expected arguments
-    std::vector<std::string_view> argumentNames;          //!< The arguments expected by the program. Ideally these would be derived from the argument container, but im not sure how since it contains templates
-    std::string_view programName;                         //!< The name of the program
-    std::string briefUsageDescription;                    //!< A one line description of the arguments
-    std::string usageDescription;                         //!< A full description of all arguments
+    std::array<size_t, N> byName{}; //!< The indices of the options sorted by name, searched while parsing
 
+  public:
     /**
-     * @brief Append an argument to the argument container and parse it if it is set
+     * @note Two options with the same name do not compile
      */
-    template <typename Type> constexpr void addArgument(Argument<Type> &arg) {
-        arg.empty = false;
-        if (isSet(arg.name)) {
-            parse(arg);
-            arg.set = true;
-        }
-
-        // TODO: dont assume formatting like this
-        if (!arg.briefDescription.empty())
-            briefUsageDescription += fmt::format("{} {} ", arg.name, arg.briefDescription);
-        if (!arg.description.empty()) {
-            if (!arg.briefDescription.empty())
-                usageDescription += fmt::format("    {} {}: {}\n", arg.name, arg.briefDescription, arg.description);
-            else
-                usageDescription += fmt::format("    {}: {}\n", arg.name, arg.description);
-        }
-
-        argumentNames.emplace_back(arg.name);
-        arguments.emplace_back(std::make_shared<Argument<Type>>(arg));
-    }
-
-    constexpr bool isSet(std::string_view argumentName) const {
-        return std::find(rawArguments.begin(), rawArguments.end(), argumentName) == rawArguments.end() ? false : true;
+    constexpr Schema(const std::array<Option, N> &options) : options{options} {
+        for (size_t i{}; i < N; i++)
+            byName[i] = i;
+        std::sort(byName.begin(), byName.end(), [this](size_t first, size_t second) {
+            return this->options[first].name < this->options[second].name;
+        });
+        for (size_t i{1}; i < N; i++)
+            if (this->options[byName[i - 1]].name == this->options[byName[i]].name)
+                throw std::logic_error("Two options have the same name");
     }
 
     /**
-     * @brief Get the value of the argument after the given name
+     * @brief Get the index of an option, a name that is not in the schema does not compile
      */
-    constexpr std::string_view getNextArgument(std::string_view argumentName) {
-        const auto nextArgPos{static_cast<size_t>(std::distance(rawArguments.begin(), std::find(rawArguments.begin(), rawArguments.end(), argumentName)) + 1)};
-        if (nextArgPos >= rawArguments.size())
-            throw exception("Missing argument value for '{}'", argumentName);
-
-        argumentNames.emplace_back(rawArguments[nextArgPos]);
-        return rawArguments[nextArgPos];
+    consteval size_t operator[](std::string_view name) const {
+        for (size_t i{}; i < N; i++)
+            if (options[i].name == name)
+                return i;
+        throw std::logic_error("There is no option with this name");
     }
 
     /**
-     * @brief Convert a string to a numeric type
+     * @brief Find an option by name
+     * @return Its index, or N if there is no option with the name
      */
-    template <typename Type> constexpr Type toNumber(std::string_view value, std::string_view argumentName = "") const {
-        try {
-            if constexpr (sizeof(u64) >= sizeof(Type))
-                return static_cast<Type>(std::stoull(value.data()));
-            else
-                return static_cast<Type>(std::stoi(value.data()));
-        } catch (const std::exception) {
-            if (argumentName.empty())
-                throw exception("Invalid argument value '{}'", value);
-            else
-                throw exception("Invalid argument value '{}' for '{}'", value, argumentName);
-        }
+    constexpr size_t find(std::string_view name) const {
+        const auto found{std::lower_bound(byName.begin(), byName.end(), name, [this](size_t index, std::string_view value) {
+            return options[index].name < value;
+        })};
+        return found != byName.end() && options[*found].name == name ? *found : N;
     }
+};
+
+/**
+ * @brief The value of an option, set is false if the option was not given
+ */
+template <typename Type> struct Argument {
+    Type value{};
+    bool set{};
+};
 
+/**
+ * @brief Splits the command line into the options of a schema in a single pass, nothing is allocated
+ * @note The values are only converted when they are requested. If an option is given more than once, get() returns its last value
+ */
+template <size_t N> class ArgumentParser {
+  private:
     /**
-     * @brief Convert a string to a number if the type is arithmetic
+     * @brief Where an option was found, as indices into rawArguments
      */
-    template <typename Type> constexpr Type maybeNumber(std::string_view value) const {
-        if constexpr (std::is_arithmetic_v<Type>)
-            return toNumber<Type>(value);
-        else
-            return value;
+    struct Occurrences {
+        size_t first{};
+        size_t last{};
+        size_t count{};
+    };
+
+    const Schema<N> &schema;
+    std::span<char *const> rawArguments; //!< The arguments passed to the program
+    std::array<Occurrences, N> found{};
+
+    template <typename Type> static Type Convert(std::string_view value, std::string_view name) {
+        if constexpr (std::is_arithmetic_v<Type>) {
+            Type number{};
+            const auto [end, error]{std::from_chars(value.data(), value.data() + value.size(), number)};
+            if (value.empty() || error != std::errc{} || end != value.data() + value.size())
+                throw exception("Invalid argument value '{}' for '{}'", value, name);
+            return number;
+        } else
+            return Type{value};
     }
 
-    template <typename First, typename Second> constexpr void parse(Argument<std::pair<First, Second>> &arg) {
-        auto nextArgument{getNextArgument(arg.name)};
-        arg.value = std::make_pair(maybeNumber<First>(nextArgument), maybeNumber<Second>(getNextArgument(nextArgument)));
-    }
+    template <typename Type> struct Converter {
+        static Type Values(const char *const *values, std::string_view name) {
+            return Convert<Type>(values[0], name);
+        }
+    };
 
-    template <typename Type>
-    requires(!std::is_same<bool, Type>::value) constexpr void parse(Argument<Type> &arg) {
-        arg.value = maybeNumber<Type>(getNextArgument(arg.name));
-    }
+    template <typename First, typename Second> struct Converter<std::pair<First, Second>> {
+        static std::pair<First, Second> Values(const char *const *values, std::string_view name) {
+            return {Convert<First>(values[0], name), Convert<Second>(values[1], name)};
+        }
+    };
 
-    constexpr void parse(Argument<bool> &arg) const {
-        arg.value = true;
+    /**
+     * @brief Convert the values following the option at the given position
+     */
+    template <typename Type> Type valueAt(size_t position) const {
+        if constexpr (std::is_same_v<Type, bool>)
+            return true;
+        else
+            return Converter<Type>::Values(rawArguments.data() + position + 1, rawArguments[position]);
     }
 
   public:
-    ArgumentParser(int argc, char **argv) : rawArguments{argv, argv + argc}, programName{argv[0]} {}
-
-    template <typename T> constexpr void add(const std::initializer_list<Argument<T>> args) {
-        for (auto arg : args)
-            addArgument(arg);
+    /**
+     * @throw exception If an argument is not in the schema, is missing its values or is given again although it is not repeatable
+     */
+    ArgumentParser(const Schema<N> &schema, int argc, char **argv) : schema{schema}, rawArguments{argv, static_cast<size_t>(argc)} {
+        for (size_t i{1}; i < rawArguments.size();) {
+            const std::string_view argument{rawArguments[i]};
+            const auto index{schema.find(argument)};
+            if (index == N)
+                throw exception("Unexpected argument '{}'", argument);
+            const auto &option{schema.options[index]};
+            if (i + option.values >= rawArguments.size())
+                throw exception("Missing argument value for '{}'", argument);
+
+            auto &occurrences{found[index]};
+            if (occurrences.count && !option.repeatable)
+                throw exception("'{}' can only be given once", argument);
+            if (!occurrences.count)
+                occurrences.first = i;
+            occurrences.last = i;
+            occurrences.count++;
+            i += 1 + option.values;
+        }
     }
 
     /**
-     * @brief Add an argument to the argument container
+     * @brief Get the value of an option, use the schema to get its index, such as get<int>(Options["--slot"])
+     * @throw exception If the value cannot be converted to the type
      */
-    template <typename T> constexpr Argument<T> add(Argument<T> arg) {
-        addArgument(arg);
-        return arg;
+    template <typename Type> Argument<Type> get(size_t option) const {
+        const auto &occurrences{found[option]};
+        if (!occurrences.count)
+            return {};
+        return {valueAt<Type>(occurrences.last), true};
     }
 
     /**
-     * @brief Check if the program was called with any unexpected arguments
+     * @brief Call a function with every value of a repeatable option, in the order they were given
+     * @note The arguments between the first and the last occurrence are split again, this only costs anything for options that are repeated
      */
-    constexpr void check() const {
-        for (size_t i{1}; i < rawArguments.size(); i++) {
-            auto arg{rawArguments[i]};
-            if (std::find(argumentNames.begin(), argumentNames.end(), arg) == argumentNames.end())
-                throw exception("Unexpected argument '{}'", arg);
+    template <typename Type, typename F> void forEach(size_t option, F &&function) const {
+        const auto &occurrences{found[option]};
+        for (auto i{occurrences.first}; occurrences.count && i <= occurrences.last;) {
+            const auto index{schema.find(rawArguments[i])};
+            if (index == option)
+                function(valueAt<Type>(i));
+            i += 1 + schema.options[index].values;
         }
     }
 
-    constexpr size_t size() const {
+    /**
+     * @brief How often an option was given
+     */
+    size_t count(size_t option) const {
+        return found[option].count;
+    }
+
+    /**
+     * @brief The amount of arguments, not counting the name of the program
+     */
+    size_t size() const {
         return rawArguments.size() - 1;
     }
 
-    void showUsage() {
-        fmt::print("usage: {} {}\n{}", programName.data(), briefUsageDescription.data(), usageDescription.data());
+    /**
+     * @brief Print every option with its description, this is only formatted when it is shown
+     */
+    void showUsage() const {
+        fmt::memory_buffer usage;
+        const auto out{std::back_inserter(usage)};
+        fmt::format_to(out, "usage: {} ", rawArguments[0]);
+        for (const auto &option : schema.options)
+            if (!option.valueNames.empty())
+                fmt::format_to(out, "{} {} ", option.name, option.valueNames);
+        fmt::format_to(out, "\n");
+
+        for (const auto &option : schema.options) {
+            if (option.description.empty())
+                continue;
+            if (!option.valueNames.empty())
+                fmt::format_to(out, "    {} {}: {}", option.name, option.valueNames, option.description);
+            else
+                fmt::format_to(out, "    {}: {}", option.name, option.description);
+            fmt::format_to(out, "{}\n", option.repeatable ? ". Can be given more than once" : "");
+        }
+        fmt::print("{}", std::string_view{usage.data(), usage.size()});
     }
 };
 
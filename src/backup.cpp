@@ -0,0 +1,266 @@
+#include "backup.h"
+#include "mappedfile.h"
+#include "profiler.h"
+#include <array>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <sstream>
+
+namespace {
+
+constexpr std::string_view ManifestHeader{"erutils backup 1"};
+constexpr std::string_view ManifestExtension{".manifest"};
+
+std::string ToHex(const util::Md5Hash &hash) {
+    std::string hex;
+    for (const auto byte : hash)
+        hex += fmt::format("{:02x}", byte);
+    return hex;
+}
+
+util::Md5Hash FromHex(std::string_view hex) {
+    util::Md5Hash hash{};
+    if (hex.size() != hash.size() * 2)
+        throw exception("Invalid chunk hash '{}'", hex);
+    for (size_t i{}; i < hash.size(); i++)
+        hash[i] = static_cast<u8>(std::stoul(std::string{hex.substr(i * 2, 2)}, nullptr, 16));
+    return hash;
+}
+
+/**
+ * @brief A read-only view of a whole file, mapped if the platform supports it
+ */
+class FileContents {
+  private:
+    std::optional<MappedFile> mapping;
+    std::vector<u8> buffer;
+
+  public:
+    explicit FileContents(const std::filesystem::path &path) {
+        if constexpr (MappedFile::Supported) {
+            mapping.emplace(path, MappedFile::Mode::ReadOnly);
+            return;
+        }
+
+        std::ifstream file(path, std::ios::in | std::ios::binary);
+        buffer.resize(std::filesystem::file_size(path));
+        file.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        if (!file)
+            throw exception("Failed to read '{}'", util::ToAbsolutePath(path).generic_string());
+    }
+
+    std::span<u8> bytes() {
+        return mapping ? mapping->bytes() : std::span<u8>{buffer};
+    }
+};
+
+/**
+ * @brief Hash every section of the data, sections of the same size are hashed together so the slots use the multi-buffer hasher
+ */
+std::vector<util::Md5Hash> HashSections(std::span<u8> data, std::span<const Section> sections) {
+    std::map<size_t, std::vector<size_t>> bySize;
+    for (size_t i{}; i < sections.size(); i++)
+        bySize[sections[i].size].push_back(i);
+
+    std::vector<util::Md5Hash> hashes(sections.size());
+    for (const auto &[size, indices] : bySize) {
+        std::vector<std::span<u8>> inputs;
+        for (const auto index : indices)
+            inputs.push_back(sections[index].bytesFrom(data));
+
+        const auto groupHashes{util::GenerateMd5(inputs)};
+        for (size_t i{}; i < indices.size(); i++)
+            hashes[indices[i]] = groupHashes[i];
+    }
+    return hashes;
+}
+
+} // namespace
+
+BackupStore::BackupStore(std::filesystem::path directory) : directory{std::move(directory)} {}
+
+BackupStore BackupStore::Default() {
+    return BackupStore{util::CreateDataDirectory() / "backup"};
+}
+
+std::string BackupStore::Timestamp() {
+    const auto now{std::chrono::system_clock::to_time_t(std::chrono::system_clock::now())};
+    std::array<char, 32> buffer{};
+    std::strftime(buffer.data(), buffer.size(), "%Y-%m-%d_%H-%M-%S", std::localtime(&now));
+    return buffer.data();
+}
+
+std::filesystem::path BackupStore::chunkPath(const util::Md5Hash &hash) const {
+    const auto hex{ToHex(hash)};
+    return directory / "chunks" / hex.substr(0, 2) / hex;
+}
+
+std::filesystem::path BackupStore::manifestPath(std::string_view name) const {
+    const std::filesystem::path path{name};
+    if (name.empty() || path.is_absolute() || std::find(path.begin(), path.end(), "..") != path.end())
+        throw exception("Invalid backup name '{}'", name);
+    return directory / "manifests" / fmt::format("{}{}", name, ManifestExtension);
+}
+
+std::vector<util::Md5Hash> BackupStore::hashChunks(std::span<u8> data, std::span<const Range> ranges) const {
+    std::vector<util::Md5Hash> hashes(ranges.size());
+    std::vector<size_t> hashed;
+    std::vector<Section> sections;
+    for (size_t i{}; i < ranges.size(); i++) {
+        const auto &range{ranges[i]};
+        if (range.checksum && range.checksum->size == hashes[i].size()) {
+            const auto stored{range.checksum->bytesFrom(data)};
+            std::copy(stored.begin(), stored.end(), hashes[i].begin());
+
+            // The chunk was hashed when it was stored, so data with the same bytes has the same hash. Comparing them is cheaper than hashing
+            const auto chunk{chunkPath(hashes[i])};
+            std::error_code error;
+            if (std::filesystem::file_size(chunk, error) == range.section.size && !error) {
+                FileContents contents{chunk};
+                const auto bytes{range.section.bytesFrom(data)};
+                if (std::equal(bytes.begin(), bytes.end(), contents.bytes().begin()))
+                    continue;
+            }
+        }
+        hashed.push_back(i);
+        sections.push_back(range.section);
+    }
+
+    const auto computed{HashSections(data, sections)};
+    for (size_t i{}; i < hashed.size(); i++)
+        hashes[hashed[i]] = computed[i];
+    return hashes;
+}
+
+std::string BackupStore::backup(const std::filesystem::path &saveFilePath, std::span<const Range> chunks, std::string name) const {
+    PROFILE_SCOPE("backup");
+    if (name.empty())
+        name = Timestamp();
+    auto uniqueName{name};
+    for (size_t suffix{1}; std::filesystem::exists(manifestPath(uniqueName)); suffix++)
+        uniqueName = fmt::format("{}-{}", name, suffix);
+
+    const std::filesystem::path bakFilePath{saveFilePath.string() + ".bak"};
+    const std::array<std::pair<std::string_view, std::filesystem::path>, 2> candidates{{{"save", saveFilePath}, {"bak", bakFilePath}}};
+
+    std::string manifest{fmt::format("{}\n", ManifestHeader)};
+    for (const auto &[role, path] : candidates) {
+        if (!std::filesystem::exists(path))
+            continue;
+
+        const auto size{std::filesystem::file_size(path)};
+        manifest += fmt::format("file {} {}\n", role, size);
+        if (!size)
+            continue;
+
+        const std::vector<Range> wholeFile{{Section{0, size}}};
+        const auto ranges{!chunks.empty() && chunks.back().section.length == size ? chunks : std::span<const Range>{wholeFile}};
+        FileContents contents{path};
+        const auto hashes{hashChunks(contents.bytes(), ranges)};
+
+        for (size_t i{}; i < ranges.size(); i++) {
+            const auto &section{ranges[i].section};
+            const auto chunk{chunkPath(hashes[i])};
+            // Only chunks that are not in the store yet are copied, this is what keeps a backup of a save with a single modified slot small
+            if (!std::filesystem::exists(chunk)) {
+                std::filesystem::create_directories(chunk.parent_path());
+                util::AtomicFile file{chunk};
+                file.copy(path, section.address, section.size, 0);
+                file.commit();
+            }
+            manifest += fmt::format("chunk {} {} {}\n", section.address, section.size, ToHex(hashes[i]));
+        }
+    }
+
+    // The manifest is written last, a backup that was interrupted never refers to chunks that are missing
+    const auto path{manifestPath(uniqueName)};
+    std::filesystem::create_directories(path.parent_path());
+    util::AtomicFile file{path};
+    file.write({reinterpret_cast<const u8 *>(manifest.data()), manifest.size()}, 0);
+    file.commit();
+
+    if (std::filesystem::exists(bakFilePath))
+        std::filesystem::remove(bakFilePath); // If this differentiates from ER0000.sl2 the game will claim the savefile is corrupt
+    return uniqueName;
+}
+
+std::vector<BackupStore::File> BackupStore::read(std::string_view name) const {
+    const auto path{manifestPath(name)};
+    std::ifstream input{path};
+    if (!input.is_open())
+        throw exception("Could not find a backup named '{}'", name);
+
+    std::string line;
+    if (!std::getline(input, line) || line != ManifestHeader)
+        throw exception("'{}' is not a backup manifest", util::ToAbsolutePath(path).generic_string());
+
+    std::vector<File> files;
+    while (std::getline(input, line)) {
+        std::istringstream words{line};
+        std::string kind;
+        words >> kind;
+        if (kind == "file") {
+            File file{};
+            words >> file.role >> file.size;
+            files.push_back(std::move(file));
+        } else if (kind == "chunk" && !files.empty()) {
+            size_t address{}, size{};
+            std::string hash;
+            words >> address >> size >> hash;
+            files.back().chunks.push_back({Section{address, size}, FromHex(hash)});
+        } else if (!kind.empty())
+            throw exception("Invalid line '{}' in backup '{}'", line, name);
+
+        if (words.fail())
+            throw exception("Invalid line '{}' in backup '{}'", line, name);
+    }
+    return files;
+}
+
+void BackupStore::restore(std::string_view name, const std::filesystem::path &target) const {
+    PROFILE_SCOPE("restore");
+    const auto files{read(name)};
+    const auto save{std::find_if(files.begin(), files.end(), [](const File &file) {
+        return file.role == "save";
+    })};
+    if (save == files.end())
+        throw exception("Backup '{}' does not contain a savefile", name);
+
+    util::AtomicFile file{target};
+    size_t restored{};
+    for (const auto &chunk : save->chunks) {
+        const auto path{chunkPath(chunk.hash)};
+        if (!std::filesystem::exists(path))
+            throw exception("Backup '{}' is missing chunk {}", name, ToHex(chunk.hash));
+
+        FileContents contents{path};
+        if (contents.bytes().size() != chunk.section.size || util::GenerateMd5(contents.bytes()) != chunk.hash)
+            throw exception("Backup '{}' has a corrupt chunk {}", name, ToHex(chunk.hash));
+        file.write(contents.bytes(), chunk.section.address);
+        restored += chunk.section.size;
+    }
+
+    if (restored != save->size)
+        throw exception("Backup '{}' does not cover the whole savefile", name);
+    file.commit();
+}
+
+std::vector<std::string> BackupStore::list() const {
+    std::vector<std::string> names;
+    const auto manifests{directory / "manifests"};
+    if (!std::filesystem::exists(manifests))
+        return names;
+
+    for (const auto &entry : std::filesystem::recursive_directory_iterator{manifests})
+        if (entry.is_regular_file() && entry.path().extension() == ManifestExtension) {
+            auto name{std::filesystem::relative(entry.path(), manifests)};
+            name.replace_extension();
+            names.push_back(name.generic_string());
+        }
+
+    std::sort(names.begin(), names.end());
+    return names;
+}
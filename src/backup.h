@@ -0,0 +1,87 @@
+#include "util.h"
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#pragma once
+
+/**
+ * @brief A deduplicating backup store, files are split into chunks and every unique chunk is only stored once
+ * @note Chunks are named after the MD5 hash of their contents, so the key of a slot is the same as its checksum. A manifest lists the chunks each backed up file is made of
+ */
+class BackupStore {
+  private:
+    std::filesystem::path directory;
+
+    std::filesystem::path chunkPath(const util::Md5Hash &hash) const;
+
+    std::filesystem::path manifestPath(std::string_view name) const;
+
+  public:
+    struct Chunk {
+        Section section;
+        util::Md5Hash hash;
+    };
+
+    /**
+     * @brief A range the files are split at when they are backed up
+     */
+    struct Range {
+        Section section;
+        std::optional<Section> checksum{}; //!< Where the file stores the MD5 hash of the range, if it does. See backup()
+    };
+
+    struct File {
+        std::string role; //!< Either 'save' or 'bak', the role of the file next to the save it was backed up with
+        size_t size;
+        std::vector<Chunk> chunks;
+    };
+
+  private:
+    /**
+     * @brief Get the key of every range of a file, see backup() for the ranges that are not hashed
+     */
+    std::vector<util::Md5Hash> hashChunks(std::span<u8> data, std::span<const Range> ranges) const;
+
+  public:
+
+    explicit BackupStore(std::filesystem::path directory);
+
+    /**
+     * @brief The store inside of the data directory, see util::CreateDataDirectory()
+     */
+    static BackupStore Default();
+
+    /**
+     * @brief Get a backup name from the current local time, these sort in the order they were created
+     */
+    static std::string Timestamp();
+
+    /**
+     * @brief Store a save file and its .bak file, the .bak file is removed afterwards as the game considers the save corrupt if they differ
+     * @param chunks The ranges to split the files at, files of a different size are stored as a single chunk
+     * @note A range with a stored checksum is not hashed if the store has a chunk named after that checksum with the same bytes, so backing up
+     * a save again only hashes the slots that changed. If the checksum does not match the data the range is hashed like any other
+     * @param name The name of the backup, by default Timestamp(). A suffix is added if a backup with this name already exists
+     * @return The name of the backup, which can be passed to restore()
+     */
+    std::string backup(const std::filesystem::path &saveFilePath, std::span<const Range> chunks, std::string name = {}) const;
+
+    /**
+     * @brief Rebuild the save file of a backup, all chunks are verified before the target is replaced
+     * @throw exception If the backup does not exist or any of its chunks are missing or corrupt
+     */
+    void restore(std::string_view name, const std::filesystem::path &target) const;
+
+    /**
+     * @brief Get the names of all backups in the order they were created
+     */
+    std::vector<std::string> list() const;
+
+    /**
+     * @brief Read the files listed in a manifest
+     */
+    std::vector<File> read(std::string_view name) const;
+};
@@ -0,0 +1,186 @@
+#include "../arguments.h"
+#include "../savefile/savefile.h"
+#include "../util.h"
+#include "savegenerator.h"
+#include <chrono>
+#include <cstring>
+#include <unistd.h>
+
+/**
+ * @brief Generates save files and measures the stages of loading, querying and writing them
+ * @note This is a friend of SaveFile and Slot, so the stages can be measured on their own rather than only through the public interface
+ */
+class Benchmark {
+  public:
+    struct Options {
+        size_t activeSlots{SaveFile::SlotCount}; //!< The amount of slots that contain a character
+        size_t records{2000};                   //!< The amount of item records in every active slot
+        size_t iterations{20};                  //!< How often each stage is repeated, the mean is reported
+        size_t threads{};                       //!< The amount of threads used to calculate checksums, 0 uses all available threads
+    };
+
+  private:
+    constexpr static u64 SteamId{SaveGenerator::SteamId};
+    constexpr static u64 OtherSteamId{76561198111111111};
+
+    Options options;
+    std::filesystem::path directory; //!< Holds the generated save file and the written copies, removed afterwards
+    std::filesystem::path savePath;
+    std::vector<u8> generated;
+
+    /**
+     * @brief Run a stage options.iterations times and print how long it took on average
+     * @param bytes The amount of bytes processed by a single run, 0 if it does not make sense for the stage
+     * @param items The amount of items processed by a single run, 0 if it does not make sense for the stage
+     */
+    template <typename F> void measure(std::string_view name, size_t bytes, size_t items, F &&stage) const {
+        stage(); // Warm up the caches and the page table
+        const auto start{std::chrono::steady_clock::now()};
+        for (size_t i{}; i < options.iterations; i++)
+            stage();
+        const auto seconds{std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / static_cast<double>(options.iterations)};
+
+        const auto throughput{[seconds](size_t amount, double unit) {
+            return amount ? fmt::format("{:.1f}", static_cast<double>(amount) / unit / seconds) : std::string{"-"};
+        }};
+        fmt::print("{:<26}{:>12.3f}{:>14}{:>16}\n", name, seconds * 1000, throughput(bytes, 1024 * 1024), throughput(items, 1));
+    }
+
+  public:
+    explicit Benchmark(Options options) : options{options}, directory{std::filesystem::temp_directory_path() / fmt::format("erutils-bench-{}", getpid())}, savePath{directory / "ER0000.sl2"} {
+        std::filesystem::create_directories(directory);
+        generated = SaveGenerator::WriteTo(savePath, options.activeSlots, options.records);
+    }
+
+    Benchmark(const Benchmark &) = delete;
+    Benchmark &operator=(const Benchmark &) = delete;
+
+    ~Benchmark() {
+        std::error_code error;
+        std::filesystem::remove_all(directory, error);
+    }
+
+    void run() const {
+        const auto records{options.activeSlots * options.records};
+        const auto catalogSize{GeneratedItems::items.size()};
+        fmt::print("{} active slots with {} item records each, mean of {} iterations\n\n", options.activeSlots, options.records, options.iterations);
+        fmt::print("{:<26}{:>12}{:>14}{:>16}\n", "stage", "ms", "MB/s", "items/s");
+
+        measure(MappedFile::Supported ? "loadFile (mapped)" : "loadFile", SaveFileSize, 0, [this]() {
+            const SaveFile saveFile{savePath};
+        });
+
+        SaveFile saveFile{savePath};
+        saveFile.setChecksumThreads(options.threads);
+        measure("parseSlots", 0, SaveFile::SlotCount, [&saveFile]() {
+            for (size_t i{}; i < SaveFile::SlotCount; i++) {
+                saveFile.slots[i].invalidate();
+                saveFile.slotMetadata(i);
+            }
+        });
+
+        measure("getItemQuantity (index)", options.activeSlots * Slot::SlotSectionSize, records, [this, &saveFile]() {
+            for (size_t i{}; i < options.activeSlots; i++) {
+                saveFile.slots[i].invalidate();
+                saveFile.getItem(i, saveFile.items.begin()->item);
+            }
+        });
+
+        measure("getItemQuantity (cached)", 0, options.activeSlots * catalogSize, [this, &saveFile]() {
+            u64 total{};
+            for (size_t i{}; i < options.activeSlots; i++)
+                for (const auto &entry : saveFile.items)
+                    total += saveFile.getItem(i, entry.item);
+            asm volatile("" : : "r"(total));
+        });
+
+        measure("printItems", 0, options.activeSlots * catalogSize, [this, &saveFile]() {
+            fmt::memory_buffer output;
+            for (size_t i{}; i < options.activeSlots; i++)
+                saveFile.printItems(i, &output);
+        });
+
+        measure("debugListItems", 0, records, [this, &saveFile]() {
+            fmt::memory_buffer output;
+            for (size_t i{}; i < options.activeSlots; i++)
+                saveFile.debugListItems(i, &output);
+        });
+
+        measure("debugListItems (all)", 0, records, [&saveFile]() {
+            fmt::memory_buffer output;
+            saveFile.debugListItems(std::nullopt, &output);
+        });
+
+        auto data{generated};
+        std::array<u8, sizeof(u64)> from{}, to{};
+        std::memcpy(from.data(), &SteamId, sizeof(u64));
+        std::memcpy(to.data(), &OtherSteamId, sizeof(u64));
+        measure("ReplaceAll", SaveFileSize, 0, [&data, &from, &to]() {
+            util::ReplaceAll(data, from, to);
+            std::swap(from, to);
+        });
+
+        const auto hashed{SaveFile::SlotCount * Slot::SlotSectionSize + SaveFile::SaveHeaderSection.size};
+        measure("recalculateChecksums", hashed, 0, [&saveFile]() {
+            saveFile.dirty.mark(SaveFile::SaveHeaderSection);
+            for (const auto &slot : saveFile.slots)
+                saveFile.dirty.mark(slot.SlotSection);
+            saveFile.recalculateChecksums(saveFile.saveData);
+        });
+
+        const auto outputPath{directory / "written.sl2"};
+        measure("write", SaveFileSize, 0, [&saveFile, &outputPath]() {
+            saveFile.write(outputPath);
+        });
+        if (!options.activeSlots)
+            return;
+        measure("write (in place)", 0, 0, [&saveFile]() {
+            saveFile.setItem(0, saveFile.items.begin()->item, 1);
+            saveFile.write(saveFile.loadedPath, true);
+        });
+    }
+};
+
+namespace {
+
+using CommandLineArguments::Option;
+
+// clang-format off
+constexpr CommandLineArguments::Schema Options{std::array{
+    Option{"--slots", "<count>", "The amount of active slots in the generated savefile, by default all of them"},
+    Option{"--records", "<count>", "The amount of item records in every active slot, by default 2000"},
+    Option{"--iterations", "<count>", "How often every stage is run, by default 20"},
+    Option{"--threads", "<count>", "The amount of threads used to calculate checksums, by default all available threads"},
+    Option{"--help", "Print this help message"},
+}};
+// clang-format on
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const CommandLineArguments::ArgumentParser arguments{Options, argc, argv};
+    const auto slots{arguments.get<size_t>(Options["--slots"])};
+    const auto records{arguments.get<size_t>(Options["--records"])};
+    const auto iterations{arguments.get<size_t>(Options["--iterations"])};
+    const auto threads{arguments.get<size_t>(Options["--threads"])};
+    const auto help{arguments.get<bool>(Options["--help"])};
+
+    if (help.set) {
+        arguments.showUsage();
+        return 0;
+    }
+
+    Benchmark::Options options;
+    if (slots.set)
+        options.activeSlots = slots.value;
+    if (records.set)
+        options.records = records.value;
+    if (iterations.set)
+        options.iterations = std::max<size_t>(iterations.value, 1);
+    if (threads.set)
+        options.threads = threads.value;
+
+    const Benchmark benchmark{options};
+    benchmark.run();
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "../savefile/savefile.h"
+#include "../util.h"
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#pragma once
+
+/**
+ * @brief Builds valid save files without the game, used by the benchmarks and the tests
+ * @note This is a friend of SaveFile and Slot, the sections it fills in are private
+ */
+class SaveGenerator {
+  public:
+    constexpr static u64 SteamId{76561198000000001};
+    constexpr static size_t InventoryOffset{0x8000}; //!< Where the records start inside of a slot
+    constexpr static size_t SteamIdOffset{0x100};    //!< Where the Steam ID is repeated inside of a slot
+
+    /**
+     * @brief Where the data of a slot starts in the file
+     */
+    static size_t SlotDataOffset(size_t slot) {
+        return Slot{slot}.SlotSection.address;
+    }
+
+    /**
+     * @brief Where the save header starts in the file
+     */
+    constexpr static size_t SaveHeaderOffset() {
+        return SaveFile::SaveHeaderSection.address;
+    }
+
+    /**
+     * @brief Build a valid save file with the given amount of item records in each active slot, the first records use every item in the
+     * catalog and the rest have unknown groups
+     * @param activeSlots The amount of slots that contain a character, starting with the first
+     */
+    static std::vector<u8> Generate(size_t activeSlots, size_t records) {
+        if (activeSlots > SaveFile::SlotCount)
+            throw exception("Invalid amount of active slots {}, there are only {} slots", activeSlots, SaveFile::SlotCount);
+        if (InventoryOffset + (records + 1) * Items::InventoryIndex::RecordSize > Slot::SlotSectionSize)
+            throw exception("{} records do not fit into a slot", records);
+
+        std::vector<u8> data(SaveFileSize);
+        const SaveSpan save{data.data(), SaveFileSize};
+        std::memcpy(data.data(), "BND", SaveFile::HeaderBNDSection.size);
+        std::memcpy(data.data() + SaveFile::SteamIdSection.address, &SteamId, sizeof(u64));
+
+        const Items::Items catalog;
+        for (size_t i{}; i < SaveFile::SlotCount; i++) {
+            const Slot slot{i};
+            auto slotData{slot.dataFrom(save)};
+            if (i < activeSlots) {
+                Slot::ActiveSection.bytesFrom(save)[i] = true;
+                std::array<u8, Slot::NameSectionSize> name{};
+                const auto text{fmt::format("Bench {}", i)};
+                util::Utf8ToUtf16(text, name);
+                slot.NameSection.replace(save, name);
+                slot.LevelSection.bytesFrom(save)[0] = static_cast<u8>(10 + i);
+                const u32 seconds{static_cast<u32>(3600 * i + 61)};
+                std::memcpy(slot.SecondsPlayedSection.bytesFrom(save).data(), &seconds, sizeof(u32));
+
+                std::memcpy(slotData.data() + SteamIdOffset, &SteamId, sizeof(u64));
+                for (size_t record{}; record < records; record++) {
+                    const auto item{record < GeneratedItems::items.size() ? (catalog.begin() + record)->item : Items::Item{static_cast<u8>(record), static_cast<u8>(0xC0 + (record >> 8) % 0x3F)}};
+                    auto bytes{slotData.subspan(InventoryOffset + record * Items::InventoryIndex::RecordSize, Items::InventoryIndex::RecordSize)};
+                    std::copy(item.data.begin(), item.data.end(), bytes.begin());
+                    bytes[item.data.size()] = static_cast<u8>(record % 99 + 1);
+                }
+            }
+
+            auto checksum{util::GenerateMd5(slotData)};
+            slot.SlotChecksumSection.replace(save, checksum);
+        }
+
+        auto headerChecksum{util::GenerateMd5(SaveFile::SaveHeaderSection.bytesFrom(save))};
+        SaveFile::SaveHeaderChecksumSection.replace(save, headerChecksum);
+        return data;
+    }
+
+    /**
+     * @brief Generate a save file and write it to the given path
+     */
+    static std::vector<u8> WriteTo(const std::filesystem::path &path, size_t activeSlots = SaveFile::SlotCount, size_t records = 2000) {
+        auto data{Generate(activeSlots, records)};
+        util::AtomicFile file{path};
+        file.write(data, 0);
+        file.commit();
+        return data;
+    }
+};
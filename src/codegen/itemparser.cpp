@@ -1,91 +1,242 @@
 #include "itemparser.h"
 #include "../util.h"
+#include "perfecthash.h"
+#include <algorithm>
 #include <array>
-#include <fmt/core.h>
-#include <sstream>
-
-const std::vector<std::string> ItemParser::parseLine(std::string_view line) const {
-    std::vector<std::string> result;
-    std::stringstream stream(line.data());
-    std::string item;
-    while (std::getline(stream, item, delimiter))
-        result.push_back(item);
-    return result;
+#include <charconv>
+#include <fmt/format.h>
+#include <fstream>
+#include <iterator>
+#include <unordered_set>
+
+std::string_view ItemParser::NextLine(std::string_view &text) {
+    const auto end{text.find('\n')};
+    auto line{text.substr(0, end)};
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+    if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+    return line;
+}
+
+void ItemParser::ParseLine(std::string_view line, std::vector<std::string_view> &fields) {
+    fields.clear();
+    for (size_t start{};;) {
+        const auto end{line.find(delimiter, start)};
+        fields.push_back(line.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start));
+        if (end == std::string_view::npos)
+            break;
+        start = end + 1;
+    }
 }
 
-ItemParser::ItemParser(const std::string_view path) : file(path.data()) {
-    std::string firstLine;
-    std::getline(file, firstLine);
-    auto columns{parseLine(firstLine)};
-    for (size_t itr{}; itr < columns.size(); itr++) {
-        const auto column{columns.at(itr)};
-        if (column == nameIdentifier.name)
-            nameIdentifier.index = itr;
-        else if (column == idIdentifier.name)
-            idIdentifier.index = itr;
+ItemParser::ItemParser(const std::filesystem::path &path) {
+    std::ifstream file{path, std::ios::in | std::ios::binary};
+    if (!file.is_open())
+        throw exception("Could not open '{}'", path.generic_string());
+    contents.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+
+    rows = contents;
+    std::vector<std::string_view> columns;
+    ParseLine(NextLine(rows), columns);
+    for (auto *identifier : {&nameIdentifier, &idIdentifier}) {
+        const auto column{std::find(columns.begin(), columns.end(), identifier->name)};
+        if (column == columns.end())
+            throw exception("'{}' does not have a '{}' column", path.generic_string(), identifier->name);
+        identifier->index = static_cast<size_t>(column - columns.begin());
     }
 }
 
-const std::string ItemParser::normalise(std::string_view string) const {
+std::string ItemParser::Normalise(std::string_view string) {
     constexpr std::array<unsigned char, 11> disallowed{'[', ']', '(', ')', '\'', '.', ',', '"', ':', '!', '&'};
     std::string result{};
-    for (std::string::size_type itr{}; itr < string.size(); itr++) {
-        const auto character{string.at(itr)};
-        const auto previous{result.back()};
+    for (const auto character : string) {
+        const auto previous{result.empty() ? '\0' : result.back()};
         if ((previous == '-' && character == '+') || (previous == '-' && character == ' ') || std::find(disallowed.begin(), disallowed.end(), character) != disallowed.end())
             continue;
         else if (character == ' ')
             result += '-';
         else
-            result += static_cast<unsigned char>(std::tolower(character));
+            result += static_cast<char>(std::tolower(static_cast<unsigned char>(character)));
     }
     return result;
 }
 
-void ItemParser::generate() {
-    std::vector<std::pair<std::string, std::string>> items;
-    std::string line;
+std::vector<ItemParser::Item> ItemParser::parse() const {
+    std::vector<Item> items;
+    std::unordered_set<std::string> names;
+    std::unordered_set<std::int32_t> ids;
+    std::vector<std::string_view> columns;
+    const auto columnCount{std::max(nameIdentifier.index, idIdentifier.index) + 1};
+
+    for (auto remaining{rows}; !remaining.empty();) {
+        ParseLine(NextLine(remaining), columns);
+        if (columns.size() < columnCount)
+            continue;
 
-    while (std::getline(file, line)) {
-        const auto columns{parseLine(line)};
-        if (columns.size() < std::max(nameIdentifier.index, idIdentifier.index))
+        const auto idColumn{columns[idIdentifier.index]};
+        std::int32_t id{};
+        const auto [end, error]{std::from_chars(idColumn.data(), idColumn.data() + idColumn.size(), id)};
+        if (idColumn.empty() || error != std::errc{} || end != idColumn.data() + idColumn.size())
             continue;
-        const auto name{normalise(columns.at(nameIdentifier.index))};
-        const auto id{columns.at(idIdentifier.index)};
-        if (name.empty() || id.empty())
+        auto name{Normalise(columns[nameIdentifier.index])};
+        if (name.empty())
             continue;
 
-        // clang-format off
-        if (std::find_if(items.begin(), items.end(), [name, id](const auto item) constexpr {
-            return item.first == name || item.second == id;
-        }) != items.end())
+        // An item is skipped if either its name or its id was already seen, the first row wins
+        if (names.contains(name) || ids.contains(id))
             continue;
-        // clang-format on
-        items.push_back({normalise(columns.at(nameIdentifier.index)), columns.at(idIdentifier.index)});
+        names.insert(name);
+        ids.insert(id);
+        items.push_back({std::move(name), id});
     }
+
+    // Sorted by name so that listing the items does not need to sort them at runtime
+    std::sort(items.begin(), items.end(), [](const Item &a, const Item &b) {
+        return a.name < b.name;
+    });
+    return items;
+}
+
+std::string ItemHeader::Generate(const std::vector<ItemParser::Item> &items) {
     if (items.empty())
         throw exception("No items found while attempting to create generateditems.h");
 
-    fmt::print("#pragma once\n"
-               "#include <array>\n"
-               "#include <string_view>\n\n"
-               "namespace GeneratedItems {{\n\n"
-               "struct Item {{\n"
-               "    std::string_view name;\n"
-               "    std::int32_t id;\n"
-               "}};\n\n"
-               "constexpr static std::array<Item, {}> items{{{{\n",
-               items.size());
-    for (auto item : items)
-        fmt::print("    {{\"{}\", {}}},\n", item.first, item.second);
-    fmt::print("}}}};\n\n"
-               "}} // namespace GeneratedItems\n");
+    fmt::memory_buffer header;
+    const auto out{std::back_inserter(header)};
+    fmt::format_to(out, "#pragma once\n"
+                        "#include \"perfecthash.h\"\n"
+                        "#include <array>\n"
+                        "#include <cstdint>\n"
+                        "#include <string_view>\n\n"
+                        "namespace GeneratedItems {{\n\n"
+                        "struct Item {{\n"
+                        "    std::string_view name;\n"
+                        "    std::int32_t id;\n"
+                        "}};\n\n");
+
+    fmt::format_to(out, "constexpr static std::array<Item, {}> items{{{{\n", items.size());
+    for (const auto &item : items)
+        fmt::format_to(out, "    {{\"{}\", {}}},\n", item.name, item.id);
+    fmt::format_to(out, "}}}};\n\n");
+
+    std::vector<std::string_view> names;
+    for (const auto &item : items)
+        names.emplace_back(item.name);
+    const auto hash{BuildPerfectHash(names)};
+
+    fmt::format_to(out, "constexpr static std::array<std::int32_t, {}> displacements{{{{", hash.displacements.size());
+    for (size_t i{}; i < hash.displacements.size(); i++)
+        fmt::format_to(out, "{}{},", (i % 16) ? " " : "\n    ", hash.displacements[i]);
+    fmt::format_to(out, "\n}}}};\n\n");
+
+    fmt::format_to(out, "constexpr static std::array<std::uint16_t, {}> slots{{{{", hash.slots.size());
+    for (size_t i{}; i < hash.slots.size(); i++)
+        fmt::format_to(out, "{}{},", (i % 16) ? " " : "\n    ", hash.slots[i]);
+    fmt::format_to(out, "\n}}}};\n\n");
+
+    fmt::format_to(out,
+                   "/**\n"
+                   " * @brief Find an item in items by its normalised name without allocating\n"
+                   " * @return A pointer into items, or nullptr if there is no item with the given name\n"
+                   " */\n"
+                   "constexpr const Item *Find(std::string_view name) {{\n"
+                   "    const auto &item{{items[slots[PerfectHash::Lookup(name, displacements, slots.size())]]}};\n"
+                   "    return item.name == name ? &item : nullptr;\n"
+                   "}}\n\n"
+                   "}} // namespace GeneratedItems\n");
+    return fmt::to_string(header);
 }
 
-int main() {
+bool ItemHeader::WriteIfChanged(const std::filesystem::path &path, std::string_view contents) {
+    if (std::filesystem::exists(path) && std::filesystem::file_size(path) == contents.size()) {
+        std::ifstream existing{path, std::ios::in | std::ios::binary};
+        if (std::equal(contents.begin(), contents.end(), std::istreambuf_iterator<char>{existing}))
+            return false;
+    }
+
+    // The header is replaced in a single step, so a build that is interrupted never sees half of it
+    auto temporary{path};
+    temporary += ".tmp";
+    {
+        std::ofstream file{temporary, std::ios::out | std::ios::binary | std::ios::trunc};
+        file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        if (!file)
+            throw exception("Failed to write '{}'", temporary.generic_string());
+    }
+    std::filesystem::rename(temporary, path);
+    return true;
+}
+
+ItemHeader::PerfectHashTables ItemHeader::BuildPerfectHash(const std::vector<std::string_view> &keys) {
+    constexpr static std::int32_t MaxSeed{1 << 24};
+    const auto size{keys.size()};
+    std::vector<std::vector<size_t>> buckets(size);
+    for (size_t key{}; key < size; key++)
+        buckets[PerfectHash::Hash(keys[key], 0) % size].push_back(key);
+
+    // Buckets containing the most keys are the hardest to place, so they go first while most slots are still free
+    std::vector<size_t> order(size);
+    for (size_t i{}; i < size; i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&buckets](size_t lhs, size_t rhs) {
+        return buckets[lhs].size() > buckets[rhs].size();
+    });
+
+    PerfectHashTables tables{std::vector<std::int32_t>(size), std::vector<size_t>(size)};
+    std::vector<bool> used(size);
+    auto bucket{order.begin()};
+    for (; bucket != order.end() && buckets[*bucket].size() > 1; bucket++) {
+        std::vector<size_t> candidates;
+        std::int32_t seed{1};
+        for (; seed < MaxSeed; seed++) {
+            candidates.clear();
+            for (const auto key : buckets[*bucket]) {
+                const auto slot{PerfectHash::Hash(keys[key], static_cast<std::uint32_t>(seed)) % size};
+                if (used[slot] || std::find(candidates.begin(), candidates.end(), slot) != candidates.end())
+                    break;
+                candidates.push_back(slot);
+            }
+            if (candidates.size() == buckets[*bucket].size())
+                break;
+        }
+        if (seed == MaxSeed)
+            throw exception("Could not find a perfect hash seed for {} items", buckets[*bucket].size());
+
+        tables.displacements[*bucket] = seed;
+        for (size_t i{}; i < candidates.size(); i++) {
+            used[candidates[i]] = true;
+            tables.slots[candidates[i]] = buckets[*bucket][i];
+        }
+    }
+
+    // Buckets with a single key can point to any free slot directly
+    size_t freeSlot{};
+    for (; bucket != order.end() && buckets[*bucket].size() == 1; bucket++) {
+        while (used[freeSlot])
+            freeSlot++;
+        used[freeSlot] = true;
+        tables.displacements[*bucket] = -static_cast<std::int32_t>(freeSlot) - 1;
+        tables.slots[freeSlot] = buckets[*bucket].front();
+    }
+
+    return tables;
+}
+
+/**
+ * @brief Generate generateditems.h from the ERDB tables
+ * @note Usage: codegen [output], the header is printed to stdout if no output is given
+ */
+int main(int argc, char **argv) {
     std::fstream versionFile{"external/erdb/latest_version.txt", std::ios::in};
     std::string version;
     std::getline(versionFile, version);
-    ItemParser parser{fmt::format("external/erdb/gamedata/_Extracted/{}/EquipParamGoods.csv", version)};
-    parser.generate();
+    const std::filesystem::path directory{fmt::format("external/erdb/gamedata/_Extracted/{}", version)};
+
+    // Only goods are generated, the records of weapons, protectors and accessories in a save do not have the id, group and delimiter the
+    // lookup in Items matches
+    const auto header{ItemHeader::Generate(ItemParser{directory / "EquipParamGoods.csv"}.parse())};
+    if (argc < 2)
+        fmt::print("{}", header);
+    else if (ItemHeader::WriteIfChanged(argv[1], header))
+        fmt::print("wrote '{}'\n", argv[1]);
 }
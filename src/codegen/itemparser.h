@@ -1,11 +1,22 @@
-#include <fstream>
+#include <cstdint>
+#include <filesystem>
+#include <string>
 #include <string_view>
 #include <vector>
 
+#pragma once
+
 /**
- * @brief Parse a CSV file from erdb into a C++ file containing an array.
+ * @brief Parse a CSV file from erdb into the items of a C++ array
+ * @note The file is read once and tokenized in place, the fields are views into its contents
  */
 class ItemParser {
+  public:
+    struct Item {
+        std::string name; //!< The normalised name, see normalise()
+        std::int32_t id;
+    };
+
   private:
     struct Identifier {
         const std::string_view name;
@@ -15,13 +26,58 @@ class ItemParser {
     Identifier nameIdentifier{"Row Name"};
     Identifier idIdentifier{"Row ID"};
     constexpr static char delimiter{';'};
-    std::ifstream file;
+    std::string contents; //!< The whole file
+    std::string_view rows; //!< The lines of contents after the header
+
+    /**
+     * @brief Take the next line from the text, without its line ending
+     */
+    static std::string_view NextLine(std::string_view &text);
+
+    /**
+     * @brief Split a line into its fields, the vector is reused so tokenizing a line does not allocate
+     */
+    static void ParseLine(std::string_view line, std::vector<std::string_view> &fields);
+
+    static std::string Normalise(std::string_view string);
+
+  public:
+    explicit ItemParser(const std::filesystem::path &path);
+
+    /**
+     * @brief Parse all rows with a name and an id, rows that repeat a name or id that was already seen are skipped
+     * @return The items sorted by name
+     */
+    std::vector<Item> parse() const;
+};
+
+/**
+ * @brief Writes the parsed goods as generateditems.h
+ */
+class ItemHeader {
+  private:
+    /**
+     * @brief The tables of a minimal perfect hash, see perfecthash.h
+     */
+    struct PerfectHashTables {
+        std::vector<std::int32_t> displacements; //!< Indexed by bucket
+        std::vector<size_t> slots;               //!< The index of the key stored in each slot
+    };
 
-    const std::vector<std::string> parseLine(std::string_view line) const;
-    const std::string normalise(std::string_view string) const;
+    /**
+     * @brief Find a seed for every bucket so that all keys map to unique slots
+     */
+    static PerfectHashTables BuildPerfectHash(const std::vector<std::string_view> &keys);
 
   public:
-    void generate();
+    /**
+     * @brief Generate the header with the items and a perfect hash to look them up by name
+     */
+    static std::string Generate(const std::vector<ItemParser::Item> &items);
 
-    ItemParser(const std::string_view path);
+    /**
+     * @brief Replace the file with the contents, unless it already has them
+     * @return If the file was written, an unchanged file keeps its modification time so nothing that includes it is rebuilt
+     */
+    static bool WriteIfChanged(const std::filesystem::path &path, std::string_view contents);
 };
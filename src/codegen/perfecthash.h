@@ -0,0 +1,36 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#pragma once
+
+/**
+ * @brief A minimal perfect hash over a fixed set of strings, shared between the code generator and the generated lookup tables
+ * @note Every key gets hashed into a bucket first. Each bucket stores either the seed that maps its keys to unique slots, or the slot of its only key directly as -(slot + 1)
+ */
+namespace PerfectHash {
+
+/**
+ * @brief FNV-1a with a seed mixed into the offset basis
+ */
+constexpr std::uint32_t Hash(std::string_view key, std::uint32_t seed) {
+    std::uint32_t hash{2166136261u ^ (seed * 16777619u)};
+    for (const auto character : key) {
+        hash ^= static_cast<std::uint8_t>(character);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Get the slot a key maps to. Keys outside of the set map to an arbitrary slot, so the caller has to compare the key stored in it
+ */
+template <std::size_t Buckets> constexpr std::size_t Lookup(std::string_view key, const std::array<std::int32_t, Buckets> &displacements, std::size_t size) {
+    const auto displacement{displacements[Hash(key, 0) % Buckets]};
+    if (displacement < 0)
+        return static_cast<std::size_t>(-displacement - 1);
+    return Hash(key, static_cast<std::uint32_t>(displacement)) % size;
+}
+
+} // namespace PerfectHash
@@ -0,0 +1,158 @@
+#include "export.h"
+#include "profiler.h"
+#include <bit>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+/**
+ * @brief Append a string as a quoted JSON string, the text is UTF-8 already so only quotes, backslashes and control characters are escaped
+ */
+void AppendJsonString(fmt::memory_buffer &output, std::string_view text) {
+    output.push_back('"');
+    for (const auto character : text) {
+        if (character == '"' || character == '\\') {
+            output.push_back('\\');
+            output.push_back(character);
+        } else if (static_cast<u8>(character) < 0x20)
+            fmt::format_to(std::back_inserter(output), "\\u{:04x}", static_cast<u8>(character));
+        else
+            output.push_back(character);
+    }
+    output.push_back('"');
+}
+
+template <typename T> void AppendValue(fmt::memory_buffer &output, T value) {
+    static_assert(std::endian::native == std::endian::little, "Columnar exports are written in the byte order of the machine");
+    const auto bytes{reinterpret_cast<const char *>(&value)};
+    output.append(bytes, bytes + sizeof(T));
+}
+
+} // namespace
+
+Exporter::Format Exporter::ParseFormat(std::string_view name) {
+    if (name == "ndjson")
+        return Format::Ndjson;
+    if (name == "columnar")
+        return Format::Columnar;
+    throw exception("Unknown export format '{}', expected 'ndjson' or 'columnar'", name);
+}
+
+void Exporter::Serialize(Format format, const SaveFile &saveFile, std::string_view source, fmt::memory_buffer &output) {
+    PROFILE_SCOPE("export save");
+    if (format == Format::Ndjson)
+        SerializeNdjson(saveFile, source, output);
+    else
+        SerializeColumnar(saveFile, source, output);
+}
+
+void Exporter::SerializeNdjson(const SaveFile &saveFile, std::string_view source, fmt::memory_buffer &output) {
+    const auto out{std::back_inserter(output)};
+    const auto steamId{saveFile.steamId()};
+    fmt::format_to(out, "{{\"type\":\"save\",\"source\":");
+    AppendJsonString(output, source);
+    fmt::format_to(out, ",\"steam_id\":{}}}\n", steamId);
+
+    for (size_t slot{}; slot < SaveFile::SlotCount; slot++) {
+        if (!saveFile.isSlotActive(slot))
+            continue;
+        const auto &metadata{saveFile.slotMetadata(slot)};
+        fmt::format_to(out, "{{\"type\":\"slot\",\"source\":");
+        AppendJsonString(output, source);
+        fmt::format_to(out, ",\"steam_id\":{},\"slot\":{},\"name\":", steamId, slot);
+        AppendJsonString(output, metadata.name());
+        fmt::format_to(out, ",\"level\":{},\"time_played\":\"{}\"}}\n", metadata.level, metadata.timePlayed);
+
+        for (const auto &record : saveFile.itemRecords(slot)) {
+            fmt::format_to(out, "{{\"type\":\"item\",\"steam_id\":{},\"slot\":{},\"group\":{},\"id\":{},\"name\":", steamId, slot, record.item.group, record.item.id);
+            if (const auto entry{saveFile.items.find(record.item)})
+                AppendJsonString(output, entry->name);
+            else
+                fmt::format_to(out, "null");
+            fmt::format_to(out, ",\"quantity\":{},\"offset\":{}}}\n", record.quantity, record.offset);
+        }
+    }
+}
+
+void Exporter::SerializeColumnar(const SaveFile &saveFile, std::string_view source, fmt::memory_buffer &output) {
+    struct Row {
+        u8 slot;
+        Items::ItemRecord record;
+    };
+
+    // The records are collected first, every column is written in its own pass over them
+    std::vector<Row> rows;
+    for (size_t slot{}; slot < SaveFile::SlotCount; slot++)
+        if (saveFile.isSlotActive(slot))
+            for (const auto &record : saveFile.itemRecords(slot))
+                rows.push_back({static_cast<u8>(slot), record});
+
+    const auto steamId{saveFile.steamId()};
+    output.reserve(output.size() + 2 * sizeof(u32) + source.size() + rows.size() * (sizeof(u64) + 2 * sizeof(u32) + 3));
+    AppendValue(output, static_cast<u32>(rows.size()));
+    AppendValue(output, static_cast<u32>(source.size()));
+    output.append(source.data(), source.data() + source.size());
+    for (size_t i{}; i < rows.size(); i++)
+        AppendValue(output, steamId);
+    for (const auto &row : rows)
+        AppendValue(output, static_cast<u32>(row.record.quantity));
+    for (const auto &row : rows)
+        AppendValue(output, static_cast<u32>(row.record.offset));
+    for (const auto &row : rows)
+        AppendValue(output, row.slot);
+    for (const auto &row : rows)
+        AppendValue(output, row.record.item.group);
+    for (const auto &row : rows)
+        AppendValue(output, row.record.item.id);
+}
+
+Exporter::Exporter(Format format, std::string_view destination) : format{format}, destination{destination == "-" ? "<stdout>" : destination} {
+    if (destination == "-") {
+        file = stdout;
+        if (format == Format::Columnar)
+            buffer.append(ColumnarMagic.data(), ColumnarMagic.data() + ColumnarMagic.size());
+        return;
+    }
+
+    const std::filesystem::path path{destination};
+    file = std::fopen(path.c_str(), "a+b");
+    if (!file)
+        throw exception("Could not open '{}' to export to: {}", util::ToAbsolutePath(path).generic_string(), std::strerror(errno));
+
+    // Appending to an existing file is only valid if it is an export of the same format
+    std::array<char, ColumnarMagic.size()> magic{};
+    std::fseek(file, 0, SEEK_SET);
+    const auto read{std::fread(magic.data(), sizeof(char), magic.size(), file)};
+    const auto columnar{read == magic.size() && magic == ColumnarMagic};
+    if (read && columnar != (format == Format::Columnar)) {
+        std::fclose(file);
+        throw exception("'{}' is not {} export, it cannot be appended to", util::ToAbsolutePath(path).generic_string(), format == Format::Columnar ? "a columnar" : "an ndjson");
+    }
+    if (!read && format == Format::Columnar)
+        buffer.append(ColumnarMagic.data(), ColumnarMagic.data() + ColumnarMagic.size());
+    std::fseek(file, 0, SEEK_END); // Switching from reading to writing requires a seek
+}
+
+Exporter::~Exporter() {
+    try {
+        flush();
+    } catch (const std::exception &) {
+    }
+    if (file != stdout)
+        std::fclose(file);
+}
+
+void Exporter::append(std::string_view data) {
+    buffer.append(data.data(), data.data() + data.size());
+    if (buffer.size() >= FlushSize)
+        flush();
+}
+
+void Exporter::flush() {
+    if (buffer.size() && std::fwrite(buffer.data(), sizeof(char), buffer.size(), file) != buffer.size())
+        throw exception("Could not write the export to '{}': {}", destination, std::strerror(errno));
+    buffer.clear();
+    if (std::fflush(file))
+        throw exception("Could not write the export to '{}': {}", destination, std::strerror(errno));
+}
@@ -0,0 +1,94 @@
+#include "savefile/savefile.h"
+#include "util.h"
+#include <array>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#pragma once
+
+/**
+ * @brief Streams the slots and inventories of saves to a file in a structured format, so they do not have to be scraped from the printed text
+ * @note Everything goes through a single buffer that is written in large blocks. An existing file is appended to, so the saves of a
+ * '--batch-dir' run or of several runs can be collected in one file
+ *
+ * ndjson     One JSON object per line. Every save is a line with "type": "save", followed by a "slot" line for every active slot and an
+ *            "item" line for every item record in it
+ * columnar   The magic bytes in ColumnarMagic followed by a block for every save. A block is the u32 amount of rows, the u32 size of the path
+ *            of the save and the path, followed by the columns steam_id (u64), quantity (u32), offset (u32), slot (u8), group (u8) and id (u8)
+ *            with one value per row each. All values are little-endian
+ */
+class Exporter {
+  public:
+    enum class Format {
+        Ndjson,
+        Columnar,
+    };
+
+    constexpr static std::array<char, 8> ColumnarMagic{'E', 'R', 'C', 'O', 'L', 'v', '0', '1'}; //!< The start of every columnar file
+
+  private:
+    constexpr static size_t FlushSize{1024 * 1024}; //!< The buffer is written once it holds this many bytes
+
+    Format format;
+    std::string destination; //!< The path used in error messages
+    std::FILE *file;
+    fmt::memory_buffer buffer;
+
+    static void SerializeNdjson(const SaveFile &saveFile, std::string_view source, fmt::memory_buffer &output);
+
+    static void SerializeColumnar(const SaveFile &saveFile, std::string_view source, fmt::memory_buffer &output);
+
+  public:
+    /**
+     * @throw exception If the name is not a format
+     */
+    static Format ParseFormat(std::string_view name);
+
+    /**
+     * @brief Append the slots and items of a save in the given format, saves processed in parallel are serialized this way and then appended in order
+     * @param source The path of the save that is stored with its records
+     */
+    static void Serialize(Format format, const SaveFile &saveFile, std::string_view source, fmt::memory_buffer &output);
+
+    /**
+     * @param destination The file to append to, or '-' for stdout
+     * @throw exception If the file could not be opened, or it is not empty and not a columnar export while exporting as columnar
+     */
+    Exporter(Format format, std::string_view destination);
+
+    Exporter(const Exporter &) = delete;
+    Exporter &operator=(const Exporter &) = delete;
+
+    /**
+     * @note Anything not yet flushed is written, errors are ignored at that point
+     */
+    ~Exporter();
+
+    Format exportFormat() const {
+        return format;
+    }
+
+    /**
+     * @brief If the export goes to stdout, so the output meant for a reader has to go elsewhere
+     */
+    bool writesToStdout() const {
+        return file == stdout;
+    }
+
+    void write(const SaveFile &saveFile, std::string_view source) {
+        Serialize(format, saveFile, source, buffer);
+        if (buffer.size() >= FlushSize)
+            flush();
+    }
+
+    /**
+     * @brief Append data that was serialized with Serialize()
+     */
+    void append(std::string_view data);
+
+    /**
+     * @throw exception If the data could not be written
+     */
+    void flush();
+};
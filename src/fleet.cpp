@@ -0,0 +1,104 @@
+#include "fleet.h"
+#include "backup.h"
+#include "profiler.h"
+#include "threadpool.h"
+#include <cstdio>
+
+Fleet::Fleet(std::filesystem::path directory, size_t threads, size_t maxInFlight) : directory{directory}, saves{util::FindFilesInSubDirectories(directory, "ER0000.sl2")}, threadCount{threads ? threads : ThreadPool::DefaultThreadCount()}, maxInFlight{maxInFlight ? maxInFlight : threadCount} {}
+
+bool Fleet::process(const std::filesystem::path &path, const Actions &actions, const std::string &backupName, fmt::memory_buffer &output, fmt::memory_buffer &exported) const {
+    PROFILE_SCOPE("process save");
+    // Saves that are only printed do not need private copies of the pages they touch
+    SaveFile saveFile{path, actions.script ? MappedFile::Mode::CopyOnWrite : MappedFile::Mode::ReadOnly};
+    saveFile.setChecksumThreads(1); // The files are already processed in parallel
+    util::Print(&output, "using savefile '{}'\nSteam ID embedded in the savefile: {}\n", path.string(), saveFile.steamId());
+    if (actions.verify) {
+        const auto verification{saveFile.verify(actions.failFast)};
+        util::Print(&output, "{}\n", verification.describe());
+        if (!verification.valid())
+            return false;
+    }
+
+    if (actions.script)
+        actions.script->run(saveFile, &output);
+    if (actions.show)
+        saveFile.printActiveSlots(&output);
+    if (actions.listItems) {
+        saveFile.printSlot(actions.slot, &output);
+        util::Print(&output, "all items in slot {}:\n\n", actions.slot);
+        saveFile.printItems(actions.slot, &output);
+    }
+    if (actions.exporter)
+        Exporter::Serialize(actions.exporter->exportFormat(), saveFile, path.generic_string(), exported);
+
+    if (actions.script && actions.write && !saveFile.modified())
+        util::Print(&output, "the script did not modify '{}', it is left as it is\n", path.generic_string());
+    else if (actions.script && actions.write) {
+        // Every save in the tree has the same name, so each backup is named after the directory it was found in
+        const auto backup{BackupStore::Default().backup(path, SaveFile::BackupChunks(), fmt::format("{}/{}", backupName, std::filesystem::relative(path, directory).parent_path().generic_string()))};
+        util::Print(&output, "wrote a backup of the original savefile as '{}'\n", backup);
+        saveFile.write(path, actions.inPlace);
+        util::Print(&output, "succesfully wrote changes to '{}'\n", path.generic_string());
+    }
+    return true;
+}
+
+std::vector<Fleet::Failure> Fleet::run(const Actions &actions) const {
+    const auto backupName{BackupStore::Timestamp()};
+    std::vector<std::future<Result>> results;
+    results.reserve(saves.size());
+
+    // An export to stdout keeps it to itself, the output of the saves goes to stderr instead
+    const auto progress{actions.exporter && actions.exporter->writesToStdout() ? stderr : stdout};
+    std::vector<Failure> failures;
+    const auto printResult{[&](size_t index) {
+        Result result;
+        try {
+            result = results[index].get();
+        } catch (const std::exception &error) {
+            failures.push_back({saves[index], error.what()});
+            return;
+        }
+        result.output += '\n';
+        std::fwrite(result.output.data(), sizeof(char), result.output.size(), progress);
+        if (actions.exporter)
+            actions.exporter->append(result.exported); // A failed write stops the run, the export would be incomplete
+        if (result.corrupt)
+            failures.push_back({saves[index], "checksums do not match", true});
+    }};
+
+    {
+        ThreadPool pool{threadCount};
+        size_t printed{};
+        for (const auto &path : saves) {
+            // A finished result holds its output and export until it is printed, so no file is started until the oldest one was printed.
+            // A slow file blocks new work rather than letting the results behind it pile up
+            if (results.size() - printed == maxInFlight)
+                printResult(printed++);
+
+            results.push_back(pool.submit([this, &path, &actions, &backupName]() {
+                fmt::memory_buffer output, exported;
+                const auto valid{process(path, actions, backupName, output, exported)};
+                return Result{fmt::to_string(output), fmt::to_string(exported), !valid};
+            }));
+        }
+        for (; printed < results.size(); printed++)
+            printResult(printed);
+    }
+
+    for (const auto corrupt : {false, true}) {
+        const auto count{std::count_if(failures.begin(), failures.end(), [corrupt](const Failure &failure) {
+            return failure.corrupt == corrupt;
+        })};
+        if (!count)
+            continue;
+        if (corrupt)
+            fmt::print(progress, "{} of {} savefiles are corrupt:\n", count, saves.size());
+        else
+            fmt::print(progress, "failed to process {} of {} savefiles:\n", count, saves.size());
+        for (const auto &failure : failures)
+            if (failure.corrupt == corrupt)
+                fmt::print(progress, "    {}: {}\n", failure.path.string(), failure.message);
+    }
+    return failures;
+}
@@ -0,0 +1,72 @@
+#include "export.h"
+#include "script.h"
+#include "util.h"
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#pragma once
+
+/**
+ * @brief Applies the same actions to every save file in a directory tree, processing multiple files in parallel
+ * @note The output of every file is collected while it is processed and printed in the order the files were found
+ */
+class Fleet {
+  public:
+    struct Actions {
+        const Script *script{}; //!< The script to run on every save, if any
+        bool show{};           //!< Print all active slots
+        bool listItems{};      //!< Print the items in slot
+        size_t slot{};
+        bool write{};   //!< Back up and write saves that were modified by the script
+        bool inPlace{}; //!< Only overwrite the modified ranges when writing, see SaveFile::write()
+        Exporter *exporter{}; //!< Export every save after the script ran, in the order the files were found
+        bool verify{};        //!< Check the checksums of every save before anything else, a corrupt save is not processed any further
+        bool failFast{};      //!< Stop verifying a save at its first mismatch, see SaveFile::verify()
+    };
+
+    struct Failure {
+        std::filesystem::path path;
+        std::string message;
+        bool corrupt{}; //!< If the save was processed but its checksums do not match
+    };
+
+  private:
+    /**
+     * @brief What processing a save produced, kept until it is its turn to be printed
+     */
+    struct Result {
+        std::string output;
+        std::string exported; //!< The serialized records of the save, if it is exported
+        bool corrupt{};
+    };
+
+    std::filesystem::path directory;
+    std::vector<std::filesystem::path> saves; //!< All save files found in the directory tree
+    size_t threadCount;
+    size_t maxInFlight; //!< The amount of save files that are loaded or waiting to be printed at the same time, this caps the used memory
+
+    /**
+     * @brief Apply the actions to a single save file
+     * @param backupName The name shared by all backups of this run, the backup of each save is named after its path in the tree below it
+     * @return False if the checksums of the save do not match, see Actions::verify
+     */
+    bool process(const std::filesystem::path &path, const Actions &actions, const std::string &backupName, fmt::memory_buffer &output, fmt::memory_buffer &exported) const;
+
+  public:
+    /**
+     * @param threads The amount of files processed at the same time, 0 uses ThreadPool::DefaultThreadCount()
+     * @param maxInFlight The amount of files that are loaded or waiting to be printed at the same time, 0 matches the amount of threads
+     */
+    Fleet(std::filesystem::path directory, size_t threads = 0, size_t maxInFlight = 0);
+
+    /**
+     * @brief Apply the actions to all save files, a save that fails does not stop the others from being processed
+     * @return The saves that could not be processed or are corrupt
+     */
+    std::vector<Failure> run(const Actions &actions) const;
+
+    size_t size() const {
+        return saves.size();
+    }
+};
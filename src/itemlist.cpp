@@ -0,0 +1,57 @@
+#include "itemlist.h"
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+constexpr std::string_view GroupPrefix{"all "};
+
+} // namespace
+
+ItemList::ItemList(std::istream &input, std::string source, const Items::Items &catalog) : source{std::move(source)} {
+    std::string buffer;
+    for (size_t lineNumber{1}; std::getline(input, buffer); lineNumber++) {
+        const auto line{util::Trim(buffer)};
+        if (line.empty() || line.starts_with('#'))
+            continue;
+
+        const auto separator{line.rfind('=')};
+        if (separator == std::string_view::npos)
+            throw exception("{}:{}: Expected '<item name>=<amount>' but got '{}'", this->source, lineNumber, line);
+        const auto name{util::Trim(line.substr(0, separator))};
+        const auto amount{util::Trim(line.substr(separator + 1))};
+
+        u32 quantity{};
+        try {
+            quantity = util::ToNumber<u32>(amount);
+        } catch (const std::exception &error) {
+            throw exception("{}:{}: {}", this->source, lineNumber, error.what());
+        }
+        // A quantity is stored in a single byte of the item record
+        if (quantity > std::numeric_limits<u8>::max())
+            throw exception("{}:{}: Invalid amount '{}', the largest amount is {}", this->source, lineNumber, amount, std::numeric_limits<u8>::max());
+
+        try {
+            if (name.starts_with(GroupPrefix))
+                for (const auto item : catalog.inGroup(util::Trim(name.substr(GroupPrefix.size()))))
+                    quantities.push_back({item, quantity});
+            else
+                quantities.push_back({catalog[name], quantity});
+        } catch (const std::exception &error) {
+            throw exception("{}:{}: {}", this->source, lineNumber, error.what());
+        }
+    }
+    if (input.bad())
+        throw exception("Failed to read item list '{}'", this->source);
+}
+
+ItemList ItemList::FromPath(std::string_view path, const Items::Items &catalog) {
+    if (path == "-")
+        return ItemList{std::cin, "<stdin>", catalog};
+
+    std::ifstream file{std::filesystem::path{path}};
+    if (!file.is_open())
+        throw exception("Could not open item list '{}'", util::ToAbsolutePath(path).generic_string());
+    return ItemList{file, std::string{path}, catalog};
+}
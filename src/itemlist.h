@@ -0,0 +1,41 @@
+#include "savefile/items.h"
+#include "util.h"
+#include <istream>
+#include <span>
+#include <string>
+#include <vector>
+
+#pragma once
+
+/**
+ * @brief The item quantities read from a file, resolved against the catalog before anything is applied
+ * @note Every line is either '<item name>=<amount>' or 'all <group>=<amount>', which sets every item of a catalog group. Lines starting with '#' are ignored
+ */
+class ItemList {
+  private:
+    std::string source; //!< The name of the file used in error messages
+    std::vector<Items::ItemQuantity> quantities;
+
+  public:
+    /**
+     * @param source The name of the file used in error messages
+     * @throw exception If a line is malformed, names an unknown item or group, or sets an amount that does not fit into a record
+     */
+    ItemList(std::istream &input, std::string source, const Items::Items &catalog);
+
+    /**
+     * @brief Read a list from a file, or from stdin if the path is '-'
+     */
+    static ItemList FromPath(std::string_view path, const Items::Items &catalog);
+
+    /**
+     * @brief The quantities in the order of the file, groups are expanded in the order of the catalog
+     */
+    std::span<const Items::ItemQuantity> items() const {
+        return quantities;
+    }
+
+    size_t size() const {
+        return quantities.size();
+    }
+};
@@ -1,35 +1,133 @@
 #include "arguments.h"
+#include "backup.h"
+#include "export.h"
+#include "fleet.h"
+#include "itemlist.h"
+#include "profiler.h"
+#include "savecache.h"
 #include "savefile/savefile.h"
+#include "script.h"
+#include "server.h"
 #include "util.h"
+#include <charconv>
 #include <fmt/format.h>
 #include <fstream>
+#include <future>
 
 #ifndef VERSION
 #define VERSION "0.0.1"
 #endif
 
+namespace {
+
+using CommandLineArguments::Option;
+
+constexpr int CorruptStatus{2}; //!< The exit status of '--verify' if a checksum does not match, failing to process a savefile exits with 1
+
+/**
+ * @brief A slot to import and the slot it is imported into
+ */
+struct Import {
+    SlotSource::Request source;
+    size_t target;
+};
+
+/**
+ * @brief Parse '<savefile>:<slot>[:<target slot>]', the numbers are split off from the end so the path may contain colons
+ * @param defaultTarget The target slot if the argument has none
+ */
+Import ParseImport(std::string_view argument, size_t defaultTarget) {
+    const auto number{[argument](std::string_view text) -> std::optional<size_t> {
+        size_t value{};
+        const auto [end, error]{std::from_chars(text.data(), text.data() + text.size(), value)};
+        if (text.empty() || error != std::errc{} || end != text.data() + text.size())
+            return std::nullopt;
+        return value;
+    }};
+
+    const auto last{argument.rfind(':')};
+    if (last == std::string_view::npos || !number(argument.substr(last + 1)))
+        throw exception("Expected '<savefile>:<slot>[:<target slot>]' for '--import' but got '{}'", argument);
+    const auto previous{argument.rfind(':', last - 1)};
+    if (last && previous != std::string_view::npos)
+        if (const auto slot{number(argument.substr(previous + 1, last - previous - 1))})
+            return {{std::filesystem::path{argument.substr(0, previous)}, *slot}, *number(argument.substr(last + 1))};
+    return {{std::filesystem::path{argument.substr(0, last)}, *number(argument.substr(last + 1))}, defaultTarget};
+}
+
+// clang-format off
+constexpr CommandLineArguments::Schema Options{std::array{
+    Option{"--save", "<savefile>", "The savefile to edit, by default this is the savefile found in Steams AppData directory"},
+    Option{"--steam-id", "<Steam ID>", "Replace the Steam ID embedded in the savefile. This should be a number with 17 digits"},
+    Option{"--slot", "<slot number>", "The index of the slot to edit, by default the first. Use --show to list all available options"},
+    Option{"--show", "View information about all active slots"},
+    Option{"--rename", "<new name>", "Rename the character in the specified slot"},
+    Option{"--copy", "<slot number>", "Copy the slot specified by '--slot' to a new slot"},
+    Option{"--import", "<savefile>:<slot>[:<target slot>]", "Import a slot from a different savefile into the target slot, by default the slot specified with '--slot'. All imported savefiles are read at the same time"}.repeated(),
+    Option{"--list-all-items", "List all the items that this program can edit"},
+    Option{"--list-items", "List all items collected in the specified slot"},
+    Option{"--set-item", "<item name> <amount>", "Change the amount of an item in the specified slot"}.repeated(),
+    Option{"--set-items", "<file|->", "Change the amount of many items in the specified slot at once. Every line is '<item name>=<amount>', or 'all <group>=<amount>' for a whole group such as 'all SmithingStone'"},
+    Option{"--debug-list-items", "List all the items that are not yet implemented, useful for debugging"},
+    Option{"--diff", "<savefile>", "List every range that differs in another savefile, with the section and items it changes. Use '--slot' to only compare a single slot"},
+    Option{"--export", "<ndjson|columnar> <file|->", "Export the active slots and every item record in them for analysis, appending to the file if it exists. With '--batch-dir' every savefile is exported into the same file"},
+    Option{"--verify", "Check that the save header and every slot match their stored checksums, without writing anything. Exits with status 2 if a checksum does not match"},
+    Option{"--fail-fast", "Make '--verify' stop at the first checksum that does not match"},
+    Option{"--all-slots", "Make '--debug-list-items' list the items of every slot at once, rather than only the specified slot"},
+    Option{"--output", "<savefile>", "Write the edited savefile to a new file"},
+    Option{"--merge", "If the savefile was changed by another program since it was loaded, keep the slots it changed rather than refusing to write. Fails if the same slot was edited by both"},
+    Option{"--in-place", "Only overwrite the modified parts of the savefile, rather than rewriting all of it. Writing a savefile that was not modified recalculates all of its checksums"},
+    Option{"--threads", "<count>", "The amount of threads used to calculate checksums, by default all available threads. Use 1 for reproducible profiling"},
+    Option{"--script", "<file|->", "Apply the operations in a script to the savefile before any other option, '-' reads it from stdin. The savefile is backed up and written once at the end"},
+    Option{"--restore", "<backup>", "Restore the savefile, or '--output', from a backup. The name of each backup is printed when it is made"},
+    Option{"--batch-dir", "<directory>", "Run '--show', '--list-items', '--script', '--verify' or '--export' on every ER0000.sl2 in a directory tree, '--threads' sets how many savefiles are processed at once"},
+    Option{"--in-flight", "<count>", "The amount of savefiles loaded or waiting to be printed at the same time with '--batch-dir', by default the amount of threads"},
+    Option{"--serve", "<socket>", "Keep savefiles loaded and apply requests sent to a Unix socket, one per line. Send 'open <savefile>' first, then any '--script' operation, 'show', 'list-items <slot>' or 'write'"},
+    Option{"--profile", "Print how long each phase of the run took and how many bytes it processed"},
+    Option{"--trace", "<file>", "Write the phases of the run as Chrome trace-event JSON, which can be opened in chrome://tracing or Perfetto"},
+    Option{"--dry-run", "Do not write any changes to the savefile"},
+    Option{"--version", "Print the version of the program"},
+    Option{"--help", "Print this help message"},
+}};
+// clang-format on
+
+} // namespace
+
 int main(int argc, char **argv) {
-    CommandLineArguments::ArgumentParser arguments(argc, argv);
-    auto savePath{util::FindFileInSubDirectory(fmt::format("{}/.steam/steam/steamapps/compatdata/1245620/pfx/drive_c/users/steamuser/AppData/Roaming/EldenRing", util::GetEnvironmentVariable("HOME")), "ER0000.sl2")};
+    const CommandLineArguments::ArgumentParser arguments{Options, argc, argv};
     std::filesystem::path outputPath;
     bool shownSlots{false};
 
-    auto save{arguments.add<std::string_view>({"--save", "<savefile>", "The savefile to edit, by default this is the savefile found in Steams AppData directory"})};
-    auto steamId{arguments.add<u64>({"--steam-id", "<Steam ID>", "Replace the Steam ID embedded in the savefile. This should be a number with 17 digits"})}; // TODO: validation
-    auto slot{arguments.add<int>({"--slot", "<slot number>", "The index of the slot to edit, by default the first. Use --show to list all available options"})};
-    auto show{arguments.add<bool>({"--show", "View information about all active slots"})};
-    auto rename{arguments.add<std::string_view>({"--rename", "<new name>", "Rename the character in the specified slot"})};
-    auto copy{arguments.add<int>({"--copy", "<slot number>", "Copy the slot specified by '--slot' to a new slot"})};
-    auto import{arguments.add<std::pair<std::string_view, int>>({"--import", "<savefile> <slot number>", "Import a slot from a different savefile into the slot specified with '--slot'"})};
-    auto listAllItems{arguments.add<bool>({"--list-all-items", "List all the items that this program can edit"})};
-    auto listItems{arguments.add<bool>({"--list-items", "List all items collected in the specified slot"})};
-    auto setItem{arguments.add<std::pair<std::string_view, u32>>({"--set-item", "<item name> <amount>", "Change the amount of an item in the specified slot"})};
-    auto debugListItems{arguments.add<bool>({"--debug-list-items", "List all the items that are not yet implemented, useful for debugging"})};
-    auto output{arguments.add<std::string_view>({"--output", "<savefile>", "Write the edited savefile to a new file"})};
-    auto dryRun{arguments.add<bool>({"--dry-run", "Do not write any changes to the savefile"})};
-    auto version{arguments.add<bool>({"--version", "Print the version of the program"})};
-    auto help{arguments.add<bool>({"--help", "Print this help message"})};
-    arguments.check();
+    auto save{arguments.get<std::string_view>(Options["--save"])};
+    auto steamId{arguments.get<u64>(Options["--steam-id"])}; // TODO: validation
+    auto slot{arguments.get<int>(Options["--slot"])};
+    auto show{arguments.get<bool>(Options["--show"])};
+    auto rename{arguments.get<std::string_view>(Options["--rename"])};
+    auto copy{arguments.get<int>(Options["--copy"])};
+    auto listAllItems{arguments.get<bool>(Options["--list-all-items"])};
+    auto listItems{arguments.get<bool>(Options["--list-items"])};
+    const auto setItem{arguments.get<std::pair<std::string_view, u32>>(Options["--set-item"])};
+    auto setItems{arguments.get<std::string_view>(Options["--set-items"])};
+    auto debugListItems{arguments.get<bool>(Options["--debug-list-items"])};
+    auto diff{arguments.get<std::string_view>(Options["--diff"])};
+    auto exportTo{arguments.get<std::pair<std::string_view, std::string_view>>(Options["--export"])};
+    const auto verify{arguments.get<bool>(Options["--verify"])};
+    const auto failFast{arguments.get<bool>(Options["--fail-fast"])};
+    auto allSlots{arguments.get<bool>(Options["--all-slots"])};
+    auto output{arguments.get<std::string_view>(Options["--output"])};
+    auto merge{arguments.get<bool>(Options["--merge"])};
+    auto inPlace{arguments.get<bool>(Options["--in-place"])};
+    auto threads{arguments.get<size_t>(Options["--threads"])};
+    auto script{arguments.get<std::string_view>(Options["--script"])};
+    auto restore{arguments.get<std::string_view>(Options["--restore"])};
+    auto batchDir{arguments.get<std::string_view>(Options["--batch-dir"])};
+    auto inFlight{arguments.get<size_t>(Options["--in-flight"])};
+    auto serve{arguments.get<std::string_view>(Options["--serve"])};
+    auto profile{arguments.get<bool>(Options["--profile"])};
+    auto trace{arguments.get<std::string_view>(Options["--trace"])};
+    auto dryRun{arguments.get<bool>(Options["--dry-run"])};
+    auto version{arguments.get<bool>(Options["--version"])};
+    auto help{arguments.get<bool>(Options["--help"])};
 
     if (help.set) {
         arguments.showUsage();
@@ -39,37 +137,173 @@ int main(int argc, char **argv) {
         return 0;
     }
 
+    if (profile.set || trace.set) {
+        if constexpr (!Profiler::Supported)
+            throw exception("'--profile' and '--trace' are not available, erutils was built without the PROFILING option");
+        Profiler::Instance().enable();
+    }
+    const Profiler::Report report{profile.set, trace.set ? std::filesystem::path{trace.value} : std::filesystem::path{}};
+
     // TODO: default values in the argument parser
     if (!slot.set)
         slot.value = 0;
-    if (save.set)
-        savePath.value = save.value;
-    else if (!savePath.hasValue)
+
+    if (batchDir.set) {
+        std::optional<Script> operations;
+        if (script.set)
+            operations.emplace(Script::FromPath(script.value));
+
+        std::optional<Exporter> exporter;
+        if (exportTo.set)
+            exporter.emplace(Exporter::ParseFormat(exportTo.value.first), exportTo.value.second);
+
+        const Fleet fleet{batchDir.value, threads.set ? threads.value : 0, inFlight.set ? inFlight.value : 0};
+        fmt::print(exporter && exporter->writesToStdout() ? stderr : stdout, "found {} savefiles in '{}'\n\n", fleet.size(), batchDir.value);
+        const auto failures{fleet.run({
+            .script = operations ? &*operations : nullptr,
+            .show = show.set,
+            .listItems = listItems.set,
+            .slot = static_cast<size_t>(slot.value),
+            .write = !dryRun.set,
+            .inPlace = inPlace.set,
+            .exporter = exporter ? &*exporter : nullptr,
+            .verify = verify.set,
+            .failFast = failFast.set,
+        })};
+        if (exporter)
+            exporter->flush();
+        if (std::any_of(failures.begin(), failures.end(), [](const Fleet::Failure &failure) {
+                return !failure.corrupt;
+            }))
+            return 1;
+        return failures.empty() ? 0 : CorruptStatus;
+    }
+    if (serve.set) {
+        Server server{serve.value, threads.set ? threads.value : 0};
+        server.run();
+        return 0;
+    }
+
+    // The save is only searched for if none was given, the cache makes finding it again a single stat
+    std::optional<SaveCache> cache;
+    Maybe<std::filesystem::path> savePath{std::filesystem::path{save.value}};
+    if (!save.set) {
+        cache.emplace(SaveCache::Default());
+        savePath = cache->find(fmt::format("{}/.steam/steam/steamapps/compatdata/1245620/pfx/drive_c/users/steamuser/AppData/Roaming/EldenRing", util::GetEnvironmentVariable("HOME")), "ER0000.sl2");
+        cache->write();
+    }
+    if (!savePath.hasValue)
         throw exception(savePath.errorMessage);
 
+    if (arguments.size() == 0) {
+        // Listing the active slots is what a run without arguments does, an unchanged save is listed from the cache without loading it
+        const auto status{SaveCache::Status(savePath.value)};
+        const auto *summary{status ? cache->summary(savePath.value, *status) : nullptr};
+        std::optional<SaveCache::Summary> loaded;
+        if (!summary) {
+            const SaveFile saveFile{savePath.value, MappedFile::Mode::ReadOnly};
+            summary = &loaded.emplace(SaveCache::Summary::Of(saveFile));
+            if (status) {
+                cache->store(savePath.value, *status, *loaded);
+                cache->write();
+            }
+        }
+
+        fmt::print("using savefile '{}'\nSteam ID embedded in the savefile: {}\n", savePath.value.string(), summary->steamId);
+        summary->printActiveSlots();
+        fmt::print("\nuse --help to see all available options\n");
+        return 0;
+    }
+
+    if (restore.set) {
+        const auto store{BackupStore::Default()};
+        const std::filesystem::path target{output.set ? std::filesystem::path{output.value} : savePath.value};
+        if (dryRun.set) {
+            store.read(restore.value);
+            fmt::print("would restore backup '{}' to '{}'\n", restore.value, target.generic_string());
+            return 0;
+        }
+
+        // The save that gets replaced is backed up as well, so a restore can be undone
+        if (std::filesystem::exists(target))
+            fmt::print("wrote a backup of '{}' as '{}'\n", target.generic_string(), store.backup(target, SaveFile::BackupChunks()));
+        store.restore(restore.value, target);
+        fmt::print("restored backup '{}' to '{}'\n", restore.value, target.generic_string());
+        return 0;
+    }
+
+    if (verify.set) {
+        SaveFile saveFile{savePath.value, MappedFile::Mode::ReadOnly};
+        if (threads.set)
+            saveFile.setChecksumThreads(threads.value);
+        const auto verification{saveFile.verify(failFast.set)};
+        fmt::print("'{}': {}\n", savePath.value.generic_string(), verification.describe());
+        return verification.valid() ? 0 : CorruptStatus;
+    }
+
+    if (exportTo.set) {
+        Exporter exporter{Exporter::ParseFormat(exportTo.value.first), exportTo.value.second};
+        // Exporting only reads the save, so it does not need private copies of the pages it touches
+        const SaveFile saveFile{savePath.value, MappedFile::Mode::ReadOnly};
+        exporter.write(saveFile, savePath.value.generic_string());
+        exporter.flush();
+        return 0;
+    }
+
+    // The imported slots are read while the target is loaded and edited, they are only needed once the imports are applied
+    std::vector<Import> imports;
+    arguments.forEach<std::string_view>(Options["--import"], [&](std::string_view argument) {
+        imports.push_back(ParseImport(argument, static_cast<size_t>(slot.value)));
+        for (size_t i{}; i + 1 < imports.size(); i++)
+            if (imports[i].target == imports.back().target)
+                throw exception("Slot {} is imported into more than once", imports.back().target);
+    });
+    std::future<std::vector<SlotSource>> importedSlots;
+    if (!imports.empty())
+        importedSlots = std::async(std::launch::async, [&imports, threads]() {
+            std::vector<SlotSource::Request> requests;
+            for (const auto &import : imports)
+                requests.push_back(import.source);
+            return SlotSource::ReadAll(requests, threads.set ? threads.value : 0);
+        });
+
     SaveFile saveFile{savePath.value};
+    if (threads.set)
+        saveFile.setChecksumThreads(threads.value);
     fmt::print("using savefile '{}'\nSteam ID embedded in the savefile: {}\n", savePath.value.string(), saveFile.steamId());
 
-    if (arguments.size() == 0) {
-        saveFile.printActiveSlots();
-        fmt::print("\nuse --help to see all available options\n");
-        exit(0);
+    if (diff.set) {
+        const SaveFile other{diff.value, MappedFile::Mode::ReadOnly};
+        fmt::print("\ndifferences to '{}':\n\n", diff.value);
+        saveFile.printDiff(other, slot.set ? std::optional<size_t>{slot.value} : std::nullopt);
+        return 0;
     }
 
+    if (script.set) {
+        // Parse the whole script first, so a typo does not leave it half applied
+        const auto operations{Script::FromPath(script.value)};
+        fmt::print("\nrunning {} operations from '{}'\n", operations.size(), script.value);
+        operations.run(saveFile);
+    }
+
+    // The Steam ID and name replacements of the following edits are applied in a single pass over the save
+    saveFile.beginBatch();
     if (steamId.set) {
         saveFile.replaceSteamId(steamId.value);
         fmt::print("Steam ID set to {}\n", steamId.value);
     }
     fmt::print("\n");
 
-    if (import.set) {
-        if (!shownSlots) {
-            saveFile.printSlot(slot.value);
-            shownSlots = true;
+    if (!imports.empty()) {
+        auto sources{importedSlots.get()};
+        for (size_t i{}; i < imports.size(); i++) {
+            if (!shownSlots)
+                saveFile.printSlot(imports[i].target);
+            saveFile.copySlot(sources[i], imports[i].target);
+            fmt::print("imported slot {} from savefile '{}' into slot {}\n", imports[i].source.slot, imports[i].source.path.generic_string(), imports[i].target);
         }
-        SaveFile importFile{import.value.first};
-        saveFile.copySlot(importFile, import.value.second, slot.value);
-        fmt::print("imported slot {} from savefile '{}' into slot {}\n\n", import.value.second, import.value.first, slot.value);
+        shownSlots = true;
+        fmt::print("\n");
     }
 
     if (rename.set) {
@@ -80,6 +314,7 @@ int main(int argc, char **argv) {
         saveFile.renameSlot(slot.value, rename.value);
         fmt::print("renamed slot {} to '{}'\n\n", slot.value, rename.value);
     }
+    saveFile.applyBatch();
 
     if (copy.set) {
         if (!shownSlots) {
@@ -100,8 +335,22 @@ int main(int argc, char **argv) {
             saveFile.printSlot(slot.value);
             shownSlots = true;
         }
-        saveFile.setItem(slot.value, saveFile.items[setItem.value.first], setItem.value.second);
-        fmt::print("set item '{}' to {}\n\n", setItem.value.first, setItem.value.second);
+        arguments.forEach<std::pair<std::string_view, u32>>(Options["--set-item"], [&](const auto &item) {
+            saveFile.setItem(slot.value, saveFile.items[item.first], item.second);
+            fmt::print("set item '{}' to {}\n", item.first, item.second);
+        });
+        fmt::print("\n");
+    }
+
+    if (setItems.set) {
+        if (!shownSlots) {
+            saveFile.printSlot(slot.value);
+            shownSlots = true;
+        }
+        // The whole list is resolved first, so an unknown item does not leave it half applied
+        const auto list{ItemList::FromPath(setItems.value, saveFile.items)};
+        saveFile.setItems(slot.value, list.items());
+        fmt::print("set {} items from '{}'\n\n", list.size(), setItems.value);
     }
 
     if (listItems.set) {
@@ -120,7 +369,11 @@ int main(int argc, char **argv) {
         fmt::print("\n");
     }
 
-    if (debugListItems.set) {
+    if (debugListItems.set && allSlots.set) {
+        fmt::print("all unrecognized items in all slots:\n\n");
+        saveFile.debugListItems(std::nullopt);
+        fmt::print("\n");
+    } else if (debugListItems.set) {
         if (!shownSlots) {
             saveFile.printSlot(slot.value);
             shownSlots = true;
@@ -135,16 +388,25 @@ int main(int argc, char **argv) {
 
     fmt::print("\n");
     if (!dryRun.set) {
-        auto backupFile{util::BackupSavefile(savePath.value)};
-        // TODO: detect if the savefile has changed since it was loaded
-        fmt::print("wrote a backup of the original savefile to '{}'\n", util::ToAbsolutePath(backupFile).generic_string());
+        // Writing over a savefile that the game changed since it was loaded would silently discard those changes
+        const std::filesystem::path target{output.set ? std::filesystem::path{output.value} : savePath.value};
+        if (std::filesystem::exists(target) && std::filesystem::equivalent(target, savePath.value)) {
+            if (merge.set) {
+                if (const auto merged{saveFile.mergeChangesOnDisk()}; !merged.empty())
+                    fmt::print("'{}' was changed since it was loaded, {}\n", savePath.value.generic_string(), merged.describe());
+            } else if (saveFile.changedOnDisk())
+                throw exception("'{}' was changed by another program since it was loaded, use '--merge' to keep the slots it changed", savePath.value.generic_string());
+        }
+
+        const auto backup{BackupStore::Default().backup(savePath.value, SaveFile::BackupChunks())};
+        fmt::print("wrote a backup of the original savefile as '{}', use '--restore {}' to restore it\n", backup, backup);
         if (output.set) {
             outputPath = output.value;
             if (std::filesystem::exists(outputPath))
                 fmt::print("the output file '{}' already exists, overwriting it\n", outputPath.generic_string());
         } else
             outputPath = savePath.value;
-        saveFile.write(outputPath);
+        saveFile.write(outputPath, inPlace.set);
         fmt::print("succesfully wrote changes to '{}'\n", outputPath.generic_string());
     }
 }
@@ -0,0 +1,45 @@
+#include "mappedfile.h"
+
+#ifdef HAS_MMAP
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(std::filesystem::path path, Mode mode) {
+    const auto fd{open(path.c_str(), O_RDONLY)};
+    if (fd == -1)
+        throw exception("Could not open file '{}': {}", util::ToAbsolutePath(path).generic_string(), std::strerror(errno));
+
+    struct stat status {};
+    if (fstat(fd, &status) == -1 || status.st_size == 0) {
+        close(fd);
+        throw exception("Could not determine the size of '{}'", util::ToAbsolutePath(path).generic_string());
+    }
+
+    length = static_cast<size_t>(status.st_size);
+    const auto protection{mode == Mode::ReadOnly ? PROT_READ : PROT_READ | PROT_WRITE};
+    auto address{mmap(nullptr, length, protection, MAP_PRIVATE, fd, 0)};
+    close(fd); // The mapping keeps its own reference to the file
+    if (address == MAP_FAILED)
+        throw exception("Could not map file '{}': {}", util::ToAbsolutePath(path).generic_string(), std::strerror(errno));
+
+    mapping = static_cast<u8 *>(address);
+}
+
+MappedFile::~MappedFile() {
+    if (mapping)
+        munmap(mapping, length);
+}
+
+#else
+
+MappedFile::MappedFile(std::filesystem::path path, Mode) {
+    throw exception("Memory mapping '{}' is not supported on this platform", util::ToAbsolutePath(path).generic_string());
+}
+
+MappedFile::~MappedFile() = default;
+
+#endif
@@ -0,0 +1,49 @@
+#include "util.h"
+#include <filesystem>
+#include <span>
+#include <utility>
+
+#pragma once
+
+#if __has_include(<sys/mman.h>)
+#define HAS_MMAP 1
+#endif
+
+/**
+ * @brief A memory mapping of a whole file, unmapped when it goes out of scope
+ */
+class MappedFile {
+  public:
+    enum class Mode {
+        ReadOnly,    //!< The mapping cannot be written to
+        CopyOnWrite, //!< Writes to the mapping are private to this process and never reach the file
+    };
+
+#ifdef HAS_MMAP
+    constexpr static bool Supported{true};
+#else
+    constexpr static bool Supported{false}; //!< If false, constructing a MappedFile will always throw
+#endif
+
+  private:
+    u8 *mapping{};
+    size_t length{};
+
+  public:
+    /**
+     * @brief Map the given file into memory
+     * @throw exception If the file could not be opened or mapped
+     */
+    MappedFile(std::filesystem::path path, Mode mode);
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept : mapping{std::exchange(other.mapping, nullptr)}, length{std::exchange(other.length, 0)} {}
+
+    ~MappedFile();
+
+    std::span<u8> bytes() const {
+        return {mapping, length};
+    }
+};
@@ -0,0 +1,253 @@
+#include "util.h"
+#include "profiler.h"
+#include <array>
+#include <cstring>
+#include <openssl/evp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAS_MULTI_BUFFER_MD5 1
+#endif
+
+namespace util {
+
+Md5Hasher::Md5Hasher() : context{EVP_MD_CTX_new()} {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    md5 = EVP_MD_fetch(nullptr, "MD5", nullptr);
+#else
+    md5 = const_cast<EVP_MD *>(EVP_md5());
+#endif
+    if (!context || !md5 || !EVP_DigestInit_ex(context, md5, nullptr))
+        throw exception("Failed to initialize an MD5 context");
+}
+
+Md5Hasher::~Md5Hasher() {
+    EVP_MD_CTX_free(context);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    EVP_MD_free(md5);
+#endif
+}
+
+Md5Hasher &Md5Hasher::update(std::span<const u8> input) {
+    EVP_DigestUpdate(context, input.data(), input.size_bytes());
+    return *this;
+}
+
+Md5Hash Md5Hasher::finalize() {
+    Md5Hash hash{};
+    EVP_DigestFinal_ex(context, hash.data(), nullptr);
+    EVP_DigestInit_ex(context, md5, nullptr);
+    return hash;
+}
+
+const Md5Hash GenerateMd5(std::span<u8> input) {
+    PROFILE_SCOPE("md5", input.size_bytes());
+    thread_local Md5Hasher hasher{};
+    return hasher.update(input).finalize();
+}
+
+#ifdef HAS_MULTI_BUFFER_MD5
+
+namespace {
+
+constexpr size_t Lanes{8};       //!< The amount of 32-bit lanes in an AVX2 register, one buffer is hashed per lane
+constexpr size_t BlockSize{64}; //!< The size of an MD5 message block
+using Lane = __m256i;
+
+// clang-format off
+constexpr std::array<u32, 64> RoundConstants{
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+constexpr std::array<int, 16> Shifts{7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21};
+// clang-format on
+
+/**
+ * @brief Transpose 8 words from each lane's buffer so that every register holds the same word of all lanes
+ */
+__attribute__((target("avx2"))) inline void Transpose(Lane (&rows)[Lanes]) {
+    const auto t0{_mm256_unpacklo_epi32(rows[0], rows[1])};
+    const auto t1{_mm256_unpackhi_epi32(rows[0], rows[1])};
+    const auto t2{_mm256_unpacklo_epi32(rows[2], rows[3])};
+    const auto t3{_mm256_unpackhi_epi32(rows[2], rows[3])};
+    const auto t4{_mm256_unpacklo_epi32(rows[4], rows[5])};
+    const auto t5{_mm256_unpackhi_epi32(rows[4], rows[5])};
+    const auto t6{_mm256_unpacklo_epi32(rows[6], rows[7])};
+    const auto t7{_mm256_unpackhi_epi32(rows[6], rows[7])};
+
+    const auto u0{_mm256_unpacklo_epi64(t0, t2)};
+    const auto u1{_mm256_unpackhi_epi64(t0, t2)};
+    const auto u2{_mm256_unpacklo_epi64(t1, t3)};
+    const auto u3{_mm256_unpackhi_epi64(t1, t3)};
+    const auto u4{_mm256_unpacklo_epi64(t4, t6)};
+    const auto u5{_mm256_unpackhi_epi64(t4, t6)};
+    const auto u6{_mm256_unpacklo_epi64(t5, t7)};
+    const auto u7{_mm256_unpackhi_epi64(t5, t7)};
+
+    rows[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    rows[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    rows[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    rows[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    rows[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    rows[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    rows[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    rows[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+template <int Shift> __attribute__((target("avx2"))) inline Lane RotateLeft(Lane value) {
+    return _mm256_or_si256(_mm256_slli_epi32(value, Shift), _mm256_srli_epi32(value, 32 - Shift));
+}
+
+/**
+ * @brief A single MD5 step, the working variables are rotated by the caller
+ */
+template <int RoundIndex, int Shift> __attribute__((target("avx2"))) inline void Step(Lane &a, Lane b, Lane c, Lane d, Lane word, u32 constant) {
+    Lane function;
+    if constexpr (RoundIndex == 0)
+        function = _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)));
+    else if constexpr (RoundIndex == 1)
+        function = _mm256_xor_si256(c, _mm256_and_si256(d, _mm256_xor_si256(b, c)));
+    else if constexpr (RoundIndex == 2)
+        function = _mm256_xor_si256(_mm256_xor_si256(b, c), d);
+    else
+        function = _mm256_xor_si256(c, _mm256_or_si256(b, _mm256_xor_si256(d, _mm256_set1_epi32(-1))));
+
+    const auto sum{_mm256_add_epi32(_mm256_add_epi32(a, function), _mm256_add_epi32(word, _mm256_set1_epi32(static_cast<int>(constant))))};
+    a = _mm256_add_epi32(b, RotateLeft<Shift>(sum));
+}
+
+/**
+ * @brief The message word used by the given step
+ */
+constexpr size_t WordIndex(size_t roundIndex, size_t step) {
+    switch (roundIndex) {
+        case 0:
+            return step % 16;
+        case 1:
+            return ((5 * step) + 1) % 16;
+        case 2:
+            return ((3 * step) + 5) % 16;
+        default:
+            return (7 * step) % 16;
+    }
+}
+
+/**
+ * @brief 16 MD5 steps, unrolled by four so the working variables rotate without any moves
+ */
+template <int RoundIndex> __attribute__((target("avx2"))) inline void Round(const Lane (&words)[16], Lane &a, Lane &b, Lane &c, Lane &d) {
+    for (size_t i{RoundIndex * 16}; i < (RoundIndex + 1) * 16; i += 4) {
+        Step<RoundIndex, Shifts[(RoundIndex * 4) + 0]>(a, b, c, d, words[WordIndex(RoundIndex, i)], RoundConstants[i]);
+        Step<RoundIndex, Shifts[(RoundIndex * 4) + 1]>(d, a, b, c, words[WordIndex(RoundIndex, i + 1)], RoundConstants[i + 1]);
+        Step<RoundIndex, Shifts[(RoundIndex * 4) + 2]>(c, d, a, b, words[WordIndex(RoundIndex, i + 2)], RoundConstants[i + 2]);
+        Step<RoundIndex, Shifts[(RoundIndex * 4) + 3]>(b, c, d, a, words[WordIndex(RoundIndex, i + 3)], RoundConstants[i + 3]);
+    }
+}
+
+/**
+ * @brief Run the MD5 compression function for one block in every lane
+ */
+__attribute__((target("avx2"))) void CompressBlocks(Lane (&state)[4], const std::array<const u8 *, Lanes> &blocks) {
+    Lane words[16];
+    for (size_t half{}; half < 2; half++) {
+        Lane rows[Lanes];
+        for (size_t lane{}; lane < Lanes; lane++)
+            rows[lane] = _mm256_loadu_si256(reinterpret_cast<const Lane *>(blocks[lane] + (half * sizeof(Lane))));
+        Transpose(rows);
+        std::copy(std::begin(rows), std::end(rows), words + (half * Lanes));
+    }
+
+    auto a{state[0]}, b{state[1]}, c{state[2]}, d{state[3]};
+    Round<0>(words, a, b, c, d);
+    Round<1>(words, a, b, c, d);
+    Round<2>(words, a, b, c, d);
+    Round<3>(words, a, b, c, d);
+
+    state[0] = _mm256_add_epi32(state[0], a);
+    state[1] = _mm256_add_epi32(state[1], b);
+    state[2] = _mm256_add_epi32(state[2], c);
+    state[3] = _mm256_add_epi32(state[3], d);
+}
+
+/**
+ * @brief Hash up to 8 buffers of the same size, unused lanes hash the last buffer again and get discarded
+ */
+__attribute__((target("avx2"))) void GenerateMd5Lanes(std::span<const std::span<u8>> inputs, std::span<Md5Hash> output) {
+    const auto size{inputs.front().size_bytes()};
+    Lane state[4]{_mm256_set1_epi32(0x67452301), _mm256_set1_epi32(static_cast<int>(0xefcdab89)), _mm256_set1_epi32(static_cast<int>(0x98badcfe)), _mm256_set1_epi32(0x10325476)};
+    std::array<const u8 *, Lanes> blocks{};
+
+    const auto fullBlocks{size / BlockSize};
+    for (size_t block{}; block < fullBlocks; block++) {
+        for (size_t lane{}; lane < Lanes; lane++)
+            blocks[lane] = inputs[std::min(lane, inputs.size() - 1)].data() + (block * BlockSize);
+        CompressBlocks(state, blocks);
+    }
+
+    // The remainder gets padded with a single set bit, zeroes and the message length in bits
+    const auto remainder{size % BlockSize};
+    const auto tailSize{remainder + 1 + sizeof(u64) > BlockSize ? BlockSize * 2 : BlockSize};
+    std::array<std::array<u8, BlockSize * 2>, Lanes> tails{};
+    const u64 bitLength{static_cast<u64>(size) * 8};
+    for (size_t lane{}; lane < Lanes; lane++) {
+        auto &tail{tails[lane]};
+        std::memcpy(tail.data(), inputs[std::min(lane, inputs.size() - 1)].data() + (fullBlocks * BlockSize), remainder);
+        tail[remainder] = 0x80;
+        std::memcpy(tail.data() + tailSize - sizeof(u64), &bitLength, sizeof(u64));
+    }
+
+    for (size_t offset{}; offset < tailSize; offset += BlockSize) {
+        for (size_t lane{}; lane < Lanes; lane++)
+            blocks[lane] = tails[lane].data() + offset;
+        CompressBlocks(state, blocks);
+    }
+
+    std::array<std::array<u32, Lanes>, 4> words;
+    for (size_t i{}; i < std::size(state); i++)
+        _mm256_storeu_si256(reinterpret_cast<Lane *>(words[i].data()), state[i]);
+    for (size_t lane{}; lane < output.size(); lane++)
+        for (size_t i{}; i < std::size(state); i++)
+            std::memcpy(output[lane].data() + (i * sizeof(u32)), &words[i][lane], sizeof(u32));
+}
+
+} // namespace
+
+#endif
+
+std::vector<Md5Hash> GenerateMd5(std::span<const std::span<u8>> inputs) {
+    size_t bytes{};
+    for (const auto input : inputs)
+        bytes += input.size_bytes();
+    PROFILE_SCOPE("md5", bytes);
+
+    std::vector<Md5Hash> hashes(inputs.size());
+    size_t hashed{};
+
+#ifdef HAS_MULTI_BUFFER_MD5
+    const auto sameSize{std::all_of(inputs.begin(), inputs.end(), [&inputs](std::span<u8> input) {
+        return input.size_bytes() == inputs.front().size_bytes();
+    })};
+
+    // A single buffer is faster to hash with OpenSSL, the lanes run at a fraction of its per-buffer speed
+    if (sameSize && __builtin_cpu_supports("avx2")) {
+        while (inputs.size() - hashed >= 2) {
+            const auto count{std::min(inputs.size() - hashed, Lanes)};
+            GenerateMd5Lanes(inputs.subspan(hashed, count), std::span{hashes}.subspan(hashed, count));
+            hashed += count;
+        }
+    }
+#endif
+
+    for (; hashed < inputs.size(); hashed++)
+        hashes[hashed] = GenerateMd5(inputs[hashed]);
+    return hashes;
+}
+
+} // namespace util
@@ -0,0 +1,112 @@
+#include "profiler.h"
+#include <algorithm>
+#include <cstdio>
+
+Profiler &Profiler::Instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+u32 Profiler::ThreadIndex() {
+    static std::atomic<u32> nextIndex;
+    thread_local const u32 index{nextIndex.fetch_add(1, std::memory_order_relaxed)};
+    return index;
+}
+
+void Profiler::enable() {
+    ThreadIndex(); // The calling thread is the main thread
+    epoch = std::chrono::steady_clock::now();
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::record(const Event &event) {
+    const std::scoped_lock lock{mutex};
+    events.push_back(event);
+}
+
+void Profiler::printSummary(fmt::memory_buffer *output) const {
+    struct Phase {
+        std::string_view name;
+        size_t calls;
+        u64 duration;
+        size_t bytes;
+    };
+
+    std::vector<Phase> phases;
+    u64 end{};
+    {
+        const std::scoped_lock lock{mutex};
+        // Events are recorded when their scope ends, so a phase is only known to have started first by its start time
+        auto sorted{events};
+        std::sort(sorted.begin(), sorted.end(), [](const Event &a, const Event &b) {
+            return a.start < b.start;
+        });
+        for (const auto &event : sorted) {
+            auto phase{std::find_if(phases.begin(), phases.end(), [&event](const Phase &phase) {
+                return phase.name == event.name;
+            })};
+            if (phase == phases.end())
+                phase = phases.insert(phases.end(), {event.name, 0, 0, 0});
+            phase->calls++;
+            phase->duration += event.duration;
+            phase->bytes += event.bytes;
+            end = std::max(end, event.start + event.duration);
+        }
+    }
+
+    util::Print(output, "\nprofile, phases running on other threads or inside of each other overlap:\n\n");
+    util::Print(output, "{:<16}{:>8}{:>12}{:>12}{:>12}\n", "phase", "calls", "total ms", "MB", "MB/s");
+    for (const auto &phase : phases) {
+        const auto milliseconds{static_cast<double>(phase.duration) / 1e6};
+        const auto megabytes{static_cast<double>(phase.bytes) / (1024 * 1024)};
+        if (phase.bytes && phase.duration)
+            util::Print(output, "{:<16}{:>8}{:>12.3f}{:>12.1f}{:>12.1f}\n", phase.name, phase.calls, milliseconds, megabytes, megabytes / (milliseconds / 1000));
+        else
+            util::Print(output, "{:<16}{:>8}{:>12.3f}{:>12}{:>12}\n", phase.name, phase.calls, milliseconds, "-", "-");
+    }
+    util::Print(output, "{:<16}{:>8}{:>12.3f}\n", "profiled", "", static_cast<double>(end) / 1e6);
+}
+
+void Profiler::writeTrace(const std::filesystem::path &path) const {
+    fmt::memory_buffer trace;
+    const auto out{std::back_inserter(trace)};
+    fmt::format_to(out, "{{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    u32 threads{};
+    std::string_view separator{};
+    {
+        const std::scoped_lock lock{mutex};
+        for (const auto &event : events) {
+            // The timestamps are in microseconds, the names are literals that never need escaping
+            fmt::format_to(out, "{}{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f},\"args\":{{\"bytes\":{}}}}}", separator, event.name, event.thread, static_cast<double>(event.start) / 1e3, static_cast<double>(event.duration) / 1e3, event.bytes);
+            separator = ",";
+            threads = std::max(threads, event.thread + 1);
+        }
+    }
+
+    for (u32 thread{}; thread < threads; thread++)
+        fmt::format_to(out, ",{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}", thread, thread ? fmt::format("worker {}", thread) : "main");
+    fmt::format_to(out, "]}}\n");
+
+    util::AtomicFile file{path};
+    file.write({reinterpret_cast<const u8 *>(trace.data()), trace.size()}, 0);
+    file.commit();
+}
+
+Profiler::Report::~Report() {
+    if (!summary && tracePath.empty())
+        return;
+
+    try {
+        const auto &profiler{Instance()};
+        if (summary)
+            profiler.printSummary();
+        if (!tracePath.empty()) {
+            profiler.writeTrace(tracePath);
+            fmt::print("wrote a trace of the run to '{}'\n", tracePath.generic_string());
+        }
+    } catch (const std::exception &error) {
+        // This runs while main returns, so the run itself already succeeded
+        std::fprintf(stderr, "failed to write the profile: %s\n", error.what());
+    }
+}
@@ -0,0 +1,132 @@
+#include "util.h"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#pragma once
+
+/**
+ * @brief Collects the timings of the phases of a run, see PROFILE_SCOPE
+ * @note Nothing is recorded until enable() is called. The PROFILING option is on by default, turning it off compiles PROFILE_SCOPE out
+ */
+class Profiler {
+  public:
+#ifdef PROFILING
+    constexpr static bool Supported{true};
+#else
+    constexpr static bool Supported{false};
+#endif
+
+    struct Event {
+        std::string_view name; //!< The name of the phase, this always refers to a string literal
+        u64 start;             //!< Nanoseconds since the profiler was enabled
+        u64 duration;          //!< In nanoseconds
+        size_t bytes;          //!< The amount of bytes processed in the phase, 0 if it does not apply
+        u32 thread;            //!< A small number identifying the thread, the thread that enabled the profiler is 0
+    };
+
+    /**
+     * @brief Prints and writes the collected events once it goes out of scope
+     */
+    class Report {
+      private:
+        bool summary;
+        std::filesystem::path tracePath;
+
+      public:
+        /**
+         * @param summary Print a table of all phases to stdout
+         * @param tracePath Write the events as Chrome trace-event JSON to this path, if it is not empty
+         */
+        Report(bool summary, std::filesystem::path tracePath) : summary{summary}, tracePath{std::move(tracePath)} {}
+
+        Report(const Report &) = delete;
+        Report &operator=(const Report &) = delete;
+
+        ~Report();
+    };
+
+  private:
+    std::atomic<bool> enabled{};
+    std::chrono::steady_clock::time_point epoch;
+    mutable std::mutex mutex;
+    std::vector<Event> events;
+
+    Profiler() = default;
+
+  public:
+    static Profiler &Instance();
+
+    /**
+     * @brief Get the number identifying the calling thread
+     */
+    static u32 ThreadIndex();
+
+    void enable();
+
+    bool isEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Get the nanoseconds since the profiler was enabled
+     */
+    u64 now() const {
+        return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+    }
+
+    /**
+     * @brief Add an event, this can be called from any thread
+     */
+    void record(const Event &event);
+
+    /**
+     * @brief Print the total time and throughput of every phase, in the order the phases were first entered
+     */
+    void printSummary(fmt::memory_buffer *output = nullptr) const;
+
+    /**
+     * @brief Write all events as Chrome trace-event JSON, which can be loaded into chrome://tracing or Perfetto
+     */
+    void writeTrace(const std::filesystem::path &path) const;
+};
+
+/**
+ * @brief Records the time between its construction and destruction as an event of the profiler
+ */
+class ProfileScope {
+  private:
+    std::string_view name;
+    size_t bytes;
+    u64 start{};
+    bool active;
+
+  public:
+    explicit ProfileScope(std::string_view name, size_t bytes = 0) : name{name}, bytes{bytes}, active{Profiler::Instance().isEnabled()} {
+        if (active)
+            start = Profiler::Instance().now();
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+    ~ProfileScope() {
+        if (active)
+            Profiler::Instance().record({name, start, Profiler::Instance().now() - start, bytes, Profiler::ThreadIndex()});
+    }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+/**
+ * @brief Time the rest of the current scope as a phase with the given name, and optionally the amount of bytes it processes
+ */
+#ifdef PROFILING
+#define PROFILE_SCOPE(...) const ProfileScope PROFILE_CONCAT(profileScope, __LINE__) { __VA_ARGS__ }
+#else
+#define PROFILE_SCOPE(...) static_cast<void>(0)
+#endif
@@ -0,0 +1,146 @@
+#include "savecache.h"
+#include "profiler.h"
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+namespace {
+
+constexpr std::string_view CacheHeader{"erutils cache 2"};
+constexpr char Separator{'\t'}; //!< Fields are separated by tabs, so paths and names may contain spaces
+
+std::vector<std::string_view> SplitFields(std::string_view line) {
+    std::vector<std::string_view> fields;
+    for (size_t start{};;) {
+        const auto end{line.find(Separator, start)};
+        fields.push_back(line.substr(start, end - start));
+        if (end == std::string_view::npos)
+            return fields;
+        start = end + 1;
+    }
+}
+
+/**
+ * @brief If a value can be stored as a field, values with separators or line breaks are not cached
+ */
+bool IsField(std::string_view value) {
+    return value.find_first_of("\t\r\n") == std::string_view::npos;
+}
+
+} // namespace
+
+SaveCache::Summary SaveCache::Summary::Of(const SaveFile &saveFile) {
+    Summary summary{.steamId = saveFile.steamId()};
+    for (size_t slot{}; slot < SaveFile::SlotCount; slot++) {
+        const auto &metadata{saveFile.slotMetadata(slot)};
+        summary.slots[slot] = {saveFile.isSlotActive(slot), metadata.level, std::string{metadata.name()}, metadata.timePlayed};
+    }
+    return summary;
+}
+
+void SaveCache::Summary::printActiveSlots(fmt::memory_buffer *output) const {
+    for (size_t slot{}; slot < slots.size(); slot++)
+        if (slots[slot].active)
+            util::Print(output, "slot {}: {}, level {}, played for {}\n", slot, slots[slot].name, slots[slot].level, slots[slot].timePlayed);
+}
+
+SaveCache::SaveCache(std::filesystem::path path) : path{std::move(path)} {
+    std::ifstream input{this->path};
+    std::string line;
+    if (!input.is_open() || !std::getline(input, line) || line != CacheHeader)
+        return;
+
+    // A cache that cannot be parsed is dropped as a whole, it is rebuilt by the following runs
+    try {
+        Entry *entry{};
+        while (std::getline(input, line)) {
+            const auto fields{SplitFields(line)};
+            if (fields[0] == "find" && fields.size() == 4) {
+                discoveries[std::filesystem::path{fields[2]}] = {util::ToNumber<u64>(fields[1]), std::filesystem::path{fields[3]}};
+                entry = nullptr;
+            } else if (fields[0] == "save" && fields.size() == 7) {
+                entry = &entries[std::filesystem::path{fields[1]}];
+                const util::FileStatus status{util::ToNumber<u64>(fields[2]), util::ToNumber<u64>(fields[3]), util::ToNumber<u64>(fields[4]), util::ToNumber<u64>(fields[5])};
+                *entry = {status, {.steamId = util::ToNumber<u64>(fields[6])}};
+            } else if (fields[0] == "slot" && fields.size() == 6 && entry) {
+                auto &slot{entry->summary.slots.at(util::ToNumber<size_t>(fields[1]))};
+                slot = {fields[2] == "1", util::ToNumber<u64>(fields[3]), std::string{fields[5]}, std::string{fields[4]}};
+            } else if (!line.empty())
+                throw exception("Invalid line '{}' in the cache", line);
+        }
+    } catch (const std::exception &) {
+        discoveries.clear();
+        entries.clear();
+    }
+}
+
+SaveCache SaveCache::Default() {
+    return SaveCache{util::CreateDataDirectory() / "cache"};
+}
+
+std::optional<util::FileStatus> SaveCache::Status(const std::filesystem::path &path) {
+    try {
+        return util::GetFileStatus(path);
+    } catch (const std::exception &) {
+        return std::nullopt;
+    }
+}
+
+Maybe<std::filesystem::path> SaveCache::find(const std::filesystem::path &directory, std::string_view filename) {
+    const auto key{directory / filename};
+    const auto searched{Status(directory)};
+    if (const auto discovery{discoveries.find(key)}; searched && discovery != discoveries.end())
+        if (discovery->second.modified == searched->modified && std::filesystem::exists(discovery->second.file))
+            return discovery->second.file;
+
+    PROFILE_SCOPE("find savefile");
+    auto found{util::FindFileInSubDirectory(directory, filename)};
+    if (found.hasValue && searched && IsField(key.string()) && IsField(found.value.string())) {
+        discoveries[key] = {searched->modified, found.value};
+        changed = true;
+    }
+    return found;
+}
+
+const SaveCache::Summary *SaveCache::summary(const std::filesystem::path &saveFilePath, const util::FileStatus &status) const {
+    const auto entry{entries.find(util::ToAbsolutePath(saveFilePath))};
+    if (entry == entries.end() || entry->second.status != status)
+        return nullptr;
+    return &entry->second.summary;
+}
+
+void SaveCache::store(const std::filesystem::path &saveFilePath, const util::FileStatus &status, Summary summary) {
+    const auto key{util::ToAbsolutePath(saveFilePath)};
+    if (!IsField(key.string()) || std::any_of(summary.slots.begin(), summary.slots.end(), [](const SlotSummary &slot) {
+            return !IsField(slot.name) || !IsField(slot.timePlayed);
+        }))
+        return;
+    entries[key] = {status, std::move(summary)};
+    changed = true;
+}
+
+void SaveCache::write() const {
+    if (!changed)
+        return;
+
+    fmt::memory_buffer contents;
+    const auto out{std::back_inserter(contents)};
+    fmt::format_to(out, "{}\n", CacheHeader);
+    for (const auto &[key, discovery] : discoveries)
+        fmt::format_to(out, "find\t{}\t{}\t{}\n", discovery.modified, key.string(), discovery.file.string());
+    for (const auto &[saveFilePath, entry] : entries) {
+        const auto &status{entry.status};
+        fmt::format_to(out, "save\t{}\t{}\t{}\t{}\t{}\t{}\n", saveFilePath.string(), status.device, status.inode, status.size, status.modified, entry.summary.steamId);
+        for (size_t slot{}; slot < entry.summary.slots.size(); slot++) {
+            const auto &summary{entry.summary.slots[slot]};
+            fmt::format_to(out, "slot\t{}\t{}\t{}\t{}\t{}\n", slot, summary.active ? 1 : 0, summary.level, summary.timePlayed, summary.name);
+        }
+    }
+
+    try {
+        util::AtomicFile file{path};
+        file.write({reinterpret_cast<const u8 *>(contents.data()), contents.size()}, 0);
+        file.commit();
+    } catch (const std::exception &) {
+    }
+}
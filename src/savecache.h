@@ -0,0 +1,100 @@
+#include "savefile/savefile.h"
+#include "util.h"
+#include <array>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#pragma once
+
+/**
+ * @brief Remembers where saves were found and the summaries of their slots, so printing the active slots of an unchanged save takes a single stat
+ * rather than walking the Steam directory and loading the save
+ * @note The cache is a single text file in the data directory, see util::CreateDataDirectory(). Every entry is checked against the file it
+ * describes before it is used, an entry that does not match is ignored and replaced. A cache that cannot be read is treated as empty
+ */
+class SaveCache {
+  public:
+    struct SlotSummary {
+        bool active{};
+        u64 level{};
+        std::string name;
+        std::string timePlayed;
+    };
+
+    /**
+     * @brief What the default listing prints about a save
+     */
+    struct Summary {
+        u64 steamId{};
+        std::array<SlotSummary, SaveFile::SlotCount> slots;
+
+        static Summary Of(const SaveFile &saveFile);
+
+        /**
+         * @brief Print the active slots, the same way as SaveFile::printActiveSlots()
+         */
+        void printActiveSlots(fmt::memory_buffer *output = nullptr) const;
+    };
+
+  private:
+    /**
+     * @brief A file found by find(), it is valid while the directory searched is not modified
+     */
+    struct Discovery {
+        u64 modified{}; //!< The modification time of the directory searched, it changes when a subdirectory is added or removed
+        std::filesystem::path file;
+    };
+
+    struct Entry {
+        util::FileStatus status;
+        Summary summary;
+    };
+
+    std::filesystem::path path;
+    std::map<std::filesystem::path, Discovery> discoveries; //!< Keyed by the directory searched joined with the filename
+    std::map<std::filesystem::path, Entry> entries;         //!< Keyed by the absolute path of the save
+    bool changed{};                                         //!< If the cache has to be written
+
+  public:
+    /**
+     * @brief Read the cache at the given path, a missing or invalid file gives an empty cache
+     */
+    explicit SaveCache(std::filesystem::path path);
+
+    /**
+     * @brief The cache inside of the data directory
+     */
+    static SaveCache Default();
+
+    /**
+     * @brief Identifies the contents of a file without reading it, a save that is written to or replaced gets a different status
+     * @return std::nullopt if the file does not exist
+     */
+    static std::optional<util::FileStatus> Status(const std::filesystem::path &path);
+
+    /**
+     * @brief The same as util::FindFileInSubDirectory(), but the directory is only searched again if it was modified since the last search
+     */
+    Maybe<std::filesystem::path> find(const std::filesystem::path &directory, std::string_view filename);
+
+    /**
+     * @brief Get the summary of a save
+     * @param status The current status of the save, see Status()
+     * @return nullptr if the save is not cached, or changed since it was
+     */
+    const Summary *summary(const std::filesystem::path &saveFilePath, const util::FileStatus &status) const;
+
+    /**
+     * @param status The status of the save taken before it was loaded, so a change while loading it is not hidden by the entry
+     */
+    void store(const std::filesystem::path &saveFilePath, const util::FileStatus &status, Summary summary);
+
+    /**
+     * @brief Write the cache if it changed
+     * @note Errors are ignored, the cache only saves time and the next run tries again
+     */
+    void write() const;
+};
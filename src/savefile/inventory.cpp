@@ -0,0 +1,104 @@
+#include "inventory.h"
+#include <algorithm>
+#include <bit>
+
+namespace Items {
+
+InventoryIndex::InventoryIndex(std::span<u8> slot) {
+    const auto delimiters{util::FindPairs(slot, ItemDelimiter)};
+    records.reserve(delimiters.size());
+
+    size_t nextFreeCandidate{};
+    for (const size_t i : delimiters) {
+        if (i < 2) // The delimiter has to be preceded by the id and group of the item
+            continue;
+
+        const auto offset{i - 2};
+        const Item item{slot[offset], slot[offset + 1]};
+        records.push_back(offset);
+        entries.try_emplace(item.key(), Entry{offset, (i + 2 < slot.size()) ? slot[i + 2] : u8{}});
+
+        // New items are placed directly after an existing record, records overlapping with the previous candidate are skipped
+        if (i >= nextFreeCandidate) {
+            if (IsFree(slot, offset + RecordSize))
+                freeEntries.push_back(offset + RecordSize);
+            nextFreeCandidate = i + FreeSize + 1;
+        }
+    }
+}
+
+bool InventoryIndex::IsFree(std::span<u8> slot, size_t offset) {
+    if (offset + FreeSize > slot.size())
+        return false;
+    return std::all_of(slot.begin() + offset, slot.begin() + offset + FreeSize, [](u8 byte) {
+        return byte == 0;
+    });
+}
+
+std::optional<InventoryIndex::Entry> InventoryIndex::find(Item item) const {
+    const auto entry{entries.find(item.key())};
+    if (entry != entries.end())
+        return entry->second;
+    return std::nullopt;
+}
+
+size_t InventoryIndex::allocate(std::span<u8> slot) {
+    if (freeEntries.empty())
+        throw exception("Could not find a free record for a new item");
+
+    const auto offset{freeEntries.front()};
+    freeEntries.pop_front();
+    // The new record is followed by another candidate, just like any other record
+    if (IsFree(slot, offset + RecordSize))
+        freeEntries.push_front(offset + RecordSize);
+    return offset;
+}
+
+void InventoryIndex::update(Item item, size_t offset, u8 quantity) {
+    const auto [entry, inserted]{entries.try_emplace(item.key(), Entry{offset, quantity})};
+    if (inserted)
+        records.insert(std::upper_bound(records.begin(), records.end(), offset), offset);
+    else if (entry->second.offset == offset)
+        entry->second.quantity = quantity;
+}
+
+ItemCensus::ItemCensus(size_t expectedRecords) : buckets(std::bit_ceil(std::max<size_t>(expectedRecords * 2, 16)), EmptyBucket) {}
+
+size_t ItemCensus::probe(u32 key) const {
+    const auto mask{buckets.size() - 1};
+    for (auto bucket{Hash(key) & mask};; bucket = (bucket + 1) & mask)
+        if (buckets[bucket] == EmptyBucket || Key(entries[buckets[bucket] - 1]) == key)
+            return bucket;
+}
+
+void ItemCensus::grow() {
+    buckets.assign(buckets.size() * 2, EmptyBucket);
+    for (size_t i{}; i < entries.size(); i++)
+        buckets[probe(Key(entries[i]))] = static_cast<u32>(i + 1);
+}
+
+void ItemCensus::add(Item item, u8 quantity, Location location) {
+    const auto key{Key(item, quantity)};
+    auto &bucket{buckets[probe(key)]};
+    if (bucket != EmptyBucket) {
+        entries[bucket - 1].locations.push_back(location);
+        return;
+    }
+
+    entries.push_back({item, quantity, {location}});
+    bucket = static_cast<u32>(entries.size());
+    // The table is kept at most half full, so probe sequences stay short
+    if (entries.size() * 2 > buckets.size())
+        grow();
+}
+
+std::vector<ItemCensus::Entry> ItemCensus::sorted() && {
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        const auto &first{a.locations.front()}, &second{b.locations.front()};
+        return first.slot != second.slot ? first.slot < second.slot : first.offset < second.offset;
+    });
+    buckets.clear();
+    return std::move(entries);
+}
+
+} // namespace Items
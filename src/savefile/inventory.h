@@ -0,0 +1,126 @@
+#include "items.h"
+#include <deque>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#pragma once
+
+namespace Items {
+
+/**
+ * @brief An index of the item records in a slot, built in a single pass over its data
+ * @note All offsets are relative to the start of the slot
+ */
+class InventoryIndex {
+  public:
+    constexpr static size_t RecordSize{12}; //!< The size of an item record, see Item
+    constexpr static size_t FreeSize{10};   //!< The amount of zeroed bytes after a record for it to be considered free
+
+    struct Entry {
+        size_t offset; //!< The offset of the first record of the item
+        u8 quantity;
+    };
+
+  private:
+    std::unordered_map<u16, Entry> entries; //!< The first record of every item, keyed by Item::key()
+    std::vector<size_t> records;             //!< The offset of every record in the slot, including duplicates
+    std::deque<size_t> freeEntries;          //!< The offsets of empty records, in the order they get used
+
+    /**
+     * @brief Check if the bytes where a new record would be are all zero
+     */
+    static bool IsFree(std::span<u8> slot, size_t offset);
+
+  public:
+    explicit InventoryIndex(std::span<u8> slot);
+
+    /**
+     * @brief Get the first record of an item, if it exists
+     */
+    std::optional<Entry> find(Item item) const;
+
+    u32 quantity(Item item) const {
+        const auto entry{find(item)};
+        return entry ? entry->quantity : 0;
+    }
+
+    const std::vector<size_t> &allRecords() const {
+        return records;
+    }
+
+    /**
+     * @brief Take the next free record, the caller is expected to write an item into it
+     * @return The offset of the record
+     * @throw exception If there are no free records left
+     */
+    size_t allocate(std::span<u8> slot);
+
+    /**
+     * @brief Patch the index after the quantity of an item was written, inserting the item if it was not indexed yet
+     */
+    void update(Item item, size_t offset, u8 quantity);
+};
+
+/**
+ * @brief Groups item records by their group, id and quantity in a single pass, used to find records of unknown items
+ * @note The groups are kept in a flat open addressing table, so adding a record is a single probe in the common case
+ */
+class ItemCensus {
+  public:
+    struct Location {
+        size_t slot;   //!< The index of the slot the record is in
+        size_t offset; //!< The offset of the delimiter of the record inside of the slot
+    };
+
+    struct Entry {
+        Item item;
+        u8 quantity;
+        std::vector<Location> locations; //!< Every record of the item with this quantity in the order they were added
+    };
+
+  private:
+    constexpr static u32 EmptyBucket{0};
+
+    std::vector<Entry> entries;
+    std::vector<u32> buckets; //!< The index of an entry plus one, or EmptyBucket. The size is always a power of two
+
+    static size_t Hash(u32 key) {
+        return static_cast<size_t>(key * 0x9E3779B1U); // Fibonacci hashing spreads the packed fields over the whole word
+    }
+
+    static u32 Key(Item item, u8 quantity) {
+        return (static_cast<u32>(item.key()) << 8) | quantity;
+    }
+
+    static u32 Key(const Entry &entry) {
+        return Key(entry.item, entry.quantity);
+    }
+
+    /**
+     * @brief Get the bucket the key is stored in, or the empty bucket it would be stored in
+     */
+    size_t probe(u32 key) const;
+
+    void grow();
+
+  public:
+    /**
+     * @param expectedRecords The amount of records that will be added, used to size the table so it does not have to grow
+     */
+    explicit ItemCensus(size_t expectedRecords = 0);
+
+    void add(Item item, u8 quantity, Location location);
+
+    size_t size() const {
+        return entries.size();
+    }
+
+    /**
+     * @brief Take the entries sorted by the first location they were found at
+     */
+    std::vector<Entry> sorted() &&;
+};
+
+} // namespace Items
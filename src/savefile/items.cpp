@@ -2,27 +2,30 @@
 
 namespace Items {
 
-const std::string Items::findId(ItemResult item) {
-    const auto result{std::find_if(this->begin(), this->end(), [item](const auto &v) {
-        return v.second.id == item.item.id;
-    })};
-    if (result != this->end())
-        return result->first;
-    return {};
+std::string_view Items::findId(ItemResult item) const {
+    const auto entry{find(item.item)};
+    return entry ? entry->name : std::string_view{};
 }
 
-ItemGroup Items::hasGroup(ItemResult item) {
-    const auto result{std::find_if(groups.begin(), groups.end(), [item](const ItemGroup &v) {
-        return v.id == item.item.group;
-    })};
-
-    if (result != groups.end())
-        return *result;
+ItemGroup Items::hasGroup(ItemResult item) const {
+    const auto name{groupNames[item.item.group]};
+    if (!name.empty())
+        return {name, item.item.group};
     return {false};
 }
 
-void ItemResult::insertDuplicate(size_t pos) {
-    duplicates.emplace_back(pos);
+std::vector<Item> Items::inGroup(std::string_view groupName) const {
+    const auto group{std::find_if(groups.begin(), groups.end(), [groupName](const ItemGroup &group) {
+        return group.name == groupName;
+    })};
+    if (group == groups.end())
+        throw exception("Unknown item group '{}'", groupName);
+
+    std::vector<Item> result;
+    for (const auto &entry : entries)
+        if (entry.item.group == group->id)
+            result.push_back(entry.item);
+    return result;
 }
 
 bool ItemResult::operator<(const ItemResult &rhs) {
@@ -32,15 +35,15 @@ bool ItemResult::operator<(const ItemResult &rhs) {
         return name < rhs.name;
 }
 
-const Item Items::operator[](std::string_view name) {
-    if (this->find(name.data()) != this->end())
-        return this->at(name.data());
+const Item Items::operator[](std::string_view name) const {
+    if (const auto item{GeneratedItems::Find(name)})
+        return CatalogEntry{*item}.item;
     throw exception("Unknown item '{}'", name);
 }
 
 void Items::print() const {
-    for (auto item : *this)
-        fmt::print("{}\n", item.first);
+    for (const auto &entry : *this)
+        fmt::print("{}\n", entry.name);
 };
 
 } // namespace Items
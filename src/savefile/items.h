@@ -1,9 +1,10 @@
 #include "../codegen/generateditems.h"
 #include "../util.h"
+#include <algorithm>
 #include <array>
-#include <list>
 #include <vector>
-#include <map>
+
+#pragma once
 
 namespace Items {
 
@@ -19,6 +20,13 @@ struct Item {
 
     constexpr Item(u8 id, u8 groupId) : id{id}, group{groupId}, data{id, groupId, ItemDelimiter.front(), ItemDelimiter.back()} {}
     constexpr Item() : data{0, 0, ItemDelimiter.front(), ItemDelimiter.back()} {}
+
+    /**
+     * @brief The group and id packed together the way they are stored in a record
+     */
+    constexpr u16 key() const {
+        return static_cast<u16>((group << 8) | id);
+    }
 };
 
 struct ItemResult {
@@ -26,60 +34,141 @@ struct ItemResult {
     size_t offset;
     Item item;
     u32 quanity{};
-    std::vector<size_t> duplicates{};
 
     bool operator<(const ItemResult &rhs);
 
-    void insertDuplicate(size_t pos);
-
     ItemResult(ItemResult result, std::string_view name, u32 quanity) : name{name}, offset{result.offset}, item{result.item}, quanity{quanity} {}
     ItemResult(ItemResult result, u32 quanity) : offset{result.offset}, item{result.item}, quanity{quanity} {}
     ItemResult(size_t offset, Item item) : offset{offset}, item{item} {}
 };
 
+/**
+ * @brief The quantity an item should be set to, see Slot::setItemQuantities()
+ */
+struct ItemQuantity {
+    Item item;
+    u32 quantity;
+};
+
+/**
+ * @brief A record of an item as it was found in a slot, see Slot::itemRecords()
+ */
+struct ItemRecord {
+    Item item;
+    u8 quantity;
+    size_t offset; //!< The offset of the delimiter of the record inside of the slot
+};
+
 struct ItemGroup {
     std::string_view name;
     u8 id;
     bool found{true};
 
-    ItemGroup(std::string_view name, u8 id) : name{name}, id{id} {}
-    ItemGroup(bool found) : found{found} {}
+    constexpr ItemGroup(std::string_view name, u8 id) : name{name}, id{id} {}
+    constexpr ItemGroup(bool found) : id{}, found{found} {}
 };
 
-// TODO: make this a struct rather than a pair. This kinda sucks.
-using ItemList = std::map<std::string, Item>;
+/**
+ * @brief An item from the generated catalog
+ */
+struct CatalogEntry {
+    std::string_view name;
+    Item item;
+
+    constexpr CatalogEntry() = default;
+    constexpr CatalogEntry(const GeneratedItems::Item &entry) : name{entry.name}, item{static_cast<u8>(entry.id & 0xff), static_cast<u8>(entry.id >> 8)} {}
+};
 
 /**
- * @brief A map of items containting data that can be searched and replaced
+ * @brief The catalog of items that can be searched and replaced, sorted by name
+ * @note All lookups go through the tables generated by the codegen target, so this does not allocate
  */
-class Items : public ItemList {
+class Items {
   private:
+    using Catalog = std::array<CatalogEntry, GeneratedItems::items.size()>;
+
+    constexpr static Catalog entries{[]() {
+        Catalog catalog{};
+        std::copy(GeneratedItems::items.begin(), GeneratedItems::items.end(), catalog.begin());
+        return catalog;
+    }()};
+
     // clang-format off
-    std::list<ItemGroup> groups{
+    constexpr static std::array<ItemGroup, 6> groups{{
         {"Rune", 0xB},
         {"SmithingStone", 0x27},
         {"FowlFoot", 0x4},
         {"CraftingMaterial", 0x51},
         {"Glovewort", 0x2A},
         {"BeastBone", 0x3B},
-    };
+    }};
     // clang-format on
 
-    ItemGroup group(std::string_view name);
+    constexpr static u16 NoEntry{0xFFFF};
+
+    /**
+     * @brief The index into entries for every possible record, indexed by Item::key(). This makes recognizing a record a single read
+     * @note Items with an id that does not fit into a record cannot be found in a save, so they are left out
+     */
+    constexpr static std::array<u16, 0x10000> reverseEntries{[]() {
+        static_assert(GeneratedItems::items.size() < NoEntry, "The catalog does not fit into the reverse lookup table");
+        std::array<u16, 0x10000> table{};
+        std::fill(table.begin(), table.end(), NoEntry);
+        for (size_t i{}; i < entries.size(); i++) {
+            const auto id{GeneratedItems::items[i].id};
+            if (id >= 0 && id <= 0xFFFF && table[entries[i].item.key()] == NoEntry)
+                table[entries[i].item.key()] = static_cast<u16>(i);
+        }
+        return table;
+    }()};
+
+    /**
+     * @brief The name of every known group, indexed by its id. Unknown groups have an empty name
+     */
+    constexpr static std::array<std::string_view, 0x100> groupNames{[]() {
+        std::array<std::string_view, 0x100> table{};
+        for (const auto &group : groups)
+            table[group.id] = group.name;
+        return table;
+    }()};
 
   public:
-    Items() {
-        for (auto item : GeneratedItems::items) {
-            Item i{static_cast<u8>(item.id & 0xff), static_cast<u8>(item.id >> 8)};
-            this->emplace(item.name, i);
-        }
+    constexpr Items() = default;
+
+    constexpr Catalog::const_iterator begin() const {
+        return entries.begin();
+    }
+
+    constexpr Catalog::const_iterator end() const {
+        return entries.end();
+    }
+
+    /**
+     * @throw exception If there is no item with the given name
+     */
+    const Item operator[](std::string_view name) const;
+
+    /**
+     * @brief Find the catalog entry with the same group and id as the given record
+     * @return A pointer into the catalog, or nullptr if the item is unknown
+     */
+    constexpr const CatalogEntry *find(Item item) const {
+        const auto index{reverseEntries[item.key()]};
+        return index != NoEntry ? &entries[index] : nullptr;
     }
 
-    const Item operator[](std::string_view name);
+    /**
+     * @brief Get the name of the item with the same group and id, or an empty string if there is none
+     */
+    std::string_view findId(ItemResult item) const;
 
-    const std::string findId(ItemResult item);
+    ItemGroup hasGroup(ItemResult item) const;
 
-    ItemGroup hasGroup(ItemResult item);
+    /**
+     * @brief Get every item of the catalog in a group, in the order of the catalog
+     * @throw exception If there is no group with the given name
+     */
+    std::vector<Item> inGroup(std::string_view groupName) const;
 
     void print() const;
 };
@@ -1,131 +1,123 @@
 #include "savefile.h"
+#include "../profiler.h"
+#include "../threadpool.h"
 #include "../util.h"
+#include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <future>
 #include <span>
 #include <string_view>
 
-void Slot::copy(SaveSpan source, SaveSpan target, size_t targetSlotIndex) const {
-    const auto targetSlotSection{ParseSlot(SlotSectionOffset, SlotSection.size, targetSlotIndex)};
-    const auto targetHeaderSection{ParseHeader(SlotHeaderSectionOffset, SlotHeaderSection.size, targetSlotIndex)};
-    targetSlotSection.replace(target, SlotSection.bytesFrom(source));
-    targetHeaderSection.replace(target, SlotHeaderSection.bytesFrom(source));
+void Slot::CopyInto(std::span<u8> slotData, std::span<u8> headerData, SaveSpan target, size_t targetSlotIndex, DirtyRegions &dirty) {
+    const auto targetSlotSection{ParseSlot(SlotSectionOffset, SlotSectionSize, targetSlotIndex)};
+    const auto targetHeaderSection{ParseHeader(SlotHeaderSectionOffset, SlotHeaderSectionSize, targetSlotIndex)};
+    targetSlotSection.replace(target, slotData, dirty);
+    targetHeaderSection.replace(target, headerData, dirty);
 }
 
-void Slot::debugListItems(SaveSpan data) {
-    const auto slot{SlotSection.bytesFrom(data)};
-    std::vector<Items::ItemResult> recognized{};
-    std::vector<Items::ItemResult> unknown{};
-    Items::Items known;
-
-    for (auto itr{slot.begin()}; itr + 2 != slot.end(); itr++) {
-        if (*itr == Items::ItemDelimiter.front() && *(itr + 1) == Items::ItemDelimiter.back()) [[unlikely]] {
-            const Items::ItemResult item{static_cast<size_t>(itr - slot.begin()), {*(itr - 2), *(itr - 1)}};
-            const auto group{known.hasGroup(item)};
-            const auto quantity{getItemQuantity(data, item.item)};
-            if (!quantity) // Probably isnt an item
-                continue;
-
-            if (group.found && known.findId(item).empty()) // Ignore items we already know
-                recognized.emplace_back(item, group.name, quantity);
-            else
-                unknown.emplace_back(item, quantity);
-        } else if (*(itr + 1) != Items::ItemDelimiter.front()) [[likely]]
-            itr++;
-    }
-
-    // TODO: this sometimes doesnt find all duplicates, no idea why
-    for (auto checking{unknown.begin()}; checking != unknown.end(); checking++) {
-        for (auto pos{checking}; pos + 1 != unknown.end(); pos++) {
-            auto duplicate{std::find_if(pos, unknown.end(), [&checking](const Items::ItemResult &cmp) {
-                if (cmp.item.group == checking->item.group && cmp.item.id == checking->item.id && checking->quanity == cmp.quanity)
-                    return true;
-                return false;
-            })};
-
-            if (duplicate == unknown.end())
-                break;
-
-            checking->insertDuplicate(duplicate->offset);
-            unknown.erase(duplicate);
-        }
-    }
+void Slot::copy(SaveSpan source, SaveSpan target, size_t targetSlotIndex, DirtyRegions &dirty) const {
+    CopyInto(SlotSection.bytesFrom(source), SlotHeaderSection.bytesFrom(source), target, targetSlotIndex, dirty);
+}
 
-    if (!unknown.empty()) {
-        fmt::print("found {} unique unknown items:\n\n", unknown.size());
-        for (auto &result : unknown) {
-            if (!result.duplicates.empty())
-                fmt::print("\n");
-            fmt::print("0x{:06X}: group: {:02X}, id: {:02X}, quanity: {}\n", result.offset, result.item.group, result.item.id, result.quanity);
-            if (!result.duplicates.empty()) {
-                for (auto &dupe : result.duplicates)
-                    fmt::print("    duplicate at 0x{:06X}\n", dupe);
-                fmt::print("\n");
-            }
-        }
+void Slot::collectUnknownItems(SaveSpan data, Items::ItemCensus &census) const {
+    const auto slot{SlotSection.bytesFrom(data)};
+    const Items::Items known;
+
+    for (const auto record : inventoryFrom(data).allRecords()) {
+        const Items::Item item{slot[record], slot[record + 1]};
+        const auto quantityOffset{record + item.data.size()};
+        const auto quantity{quantityOffset < slot.size() ? slot[quantityOffset] : u8{}};
+        if (!quantity) // Probably isnt an item
+            continue;
+        if (known.find(item)) // Ignore items we already know
+            continue;
+
+        census.add(item, quantity, {index, record + 2}); // Offsets are reported at the delimiter
     }
+}
 
-    if (!recognized.empty()) {
-        fmt::print("\nfound {} unknown items with a recognized group:\n\n", recognized.size());
-        for (auto &result : recognized)
-            fmt::print("0x{:06X}: {}, id: {:02X}, quanity: {}\n", result.offset, result.name, result.item.id, result.quanity);
+std::vector<Items::ItemRecord> Slot::itemRecords(SaveSpan data) const {
+    const auto slot{SlotSection.bytesFrom(data)};
+    const auto &records{inventoryFrom(data).allRecords()};
+    std::vector<Items::ItemRecord> found;
+    found.reserve(records.size());
+
+    for (const auto record : records) {
+        const Items::Item item{slot[record], slot[record + 1]};
+        const auto quantityOffset{record + item.data.size()};
+        const auto quantity{quantityOffset < slot.size() ? slot[quantityOffset] : u8{}};
+        if (quantity) // Records without a quantity are probably not items, see collectUnknownItems()
+            found.push_back({item, quantity, record + 2});
     }
+    return found;
 }
 
-void Slot::recalculateSlotChecksum(SaveSpan data) const {
-    auto hash{util::GenerateMd5(SlotSection.bytesFrom(data))};
-    SlotChecksumSection.replace(data, hash);
+void Slot::storeChecksum(SaveSpan data, util::Md5Hash checksum, DirtyRegions &dirty) const {
+    SlotChecksumSection.replace(data, checksum, dirty);
 }
 
-void Slot::rename(SaveSpan data, std::string_view newName) const {
+util::Replacement Slot::renameReplacement(SaveSpan data, std::string_view newName) const {
     std::array<u8, NameSectionSize> convertedName{};
-    util::Utf8ToUtf16(convertedName, std::u16string(newName.begin(), newName.end()));
+    util::Utf8ToUtf16(newName, convertedName);
     // Any characters sharing the same name will get replaced with the new name as of now
-    util::ReplaceAll<u8>(data, NameSection.bytesFrom(data), convertedName);
+    return {NameSection.bytesFrom(data), convertedName};
 }
 
-u32 Slot::getItemQuantity(SaveSpan data, Items::Item item) const {
-    auto slot{SlotSection.bytesFrom(data)};
-    const auto itr{std::search(slot.begin(), slot.end(), item.data.begin(), item.data.end())};
-    return (itr != slot.end()) ? slot[itr - slot.begin() + item.data.size()] : 0;
+const Slot::Metadata &Slot::metadataFrom(SaveSpan data) const {
+    if (!metadata) {
+        PROFILE_SCOPE("parse slot");
+        auto &parsed{metadata.emplace()};
+        parsed.level = getLevel(data);
+        parsed.nameSize = util::Utf16ToUtf8(NameSection.bytesFrom(data), parsed.nameBuffer);
+        parsed.timePlayed = getTimePlayed(data);
+    }
+    return *metadata;
 }
 
-void Slot::setItemQuantity(SaveSpan data, Items::Item item, u32 quantity) const {
-    constexpr static auto itemSize{10};
-    auto slot{SlotSection.bytesFrom(data)};
-    size_t quantityOffset{};
-
-    if (auto itr = std::search(slot.begin(), slot.end(), item.data.begin(), item.data.end()); itr != slot.end())
-        // If the item is already present we can just update the quantity
-        quantityOffset = (itr - slot.begin()) + item.data.size();
-    else {
-        // Otherwise we need to insert it. This currently works, but only for a few items.
-        for (size_t i{}; i < slot.size(); i++) {
-            // Check if an item exists at the current position
-            if (slot[i] == Items::ItemDelimiter.front() && slot[i + 1] == Items::ItemDelimiter.back()) {
-                const auto nextItem{i + itemSize};
-                const auto nextItemEnd{i + (itemSize * 2)};
-                // Check if the space after the found item is empty
-                if (std::search_n(slot.begin() + nextItem, slot.begin() + nextItemEnd, itemSize, 0x0) != slot.begin() + nextItemEnd) {
-                    // If yes, copy the requested item into it
-                    std::copy(item.data.begin(), item.data.end(), slot.begin() + nextItem);
-                    quantityOffset = nextItem + item.data.size();
-                    break;
-                } else
-                    i += itemSize;
-            }
-        }
+const Items::InventoryIndex &Slot::inventoryFrom(SaveSpan data) const {
+    if (!inventory) {
+        PROFILE_SCOPE("index items", SlotSection.size);
+        inventory.emplace(SlotSection.bytesFrom(data));
     }
+    return *inventory;
+}
 
-    if (!quantityOffset)
-        throw exception("Could not find a place for item with quantity {}", quantity);
-    slot[quantityOffset] = static_cast<u8>(quantity);
+u32 Slot::getItemQuantity(SaveSpan data, Items::Item item) const {
+    return inventoryFrom(data).quantity(item);
 }
 
-std::string Slot::getName(SaveSpan data) const {
-    return util::Utf16ToUtf8String(NameSection.bytesFrom(data));
+void Slot::setItemQuantity(SaveSpan data, Items::Item item, u32 quantity, DirtyRegions &dirty) const {
+    const std::array<Items::ItemQuantity, 1> quantities{{{item, quantity}}};
+    setItemQuantities(data, quantities, dirty);
 }
 
-void Slot::setActive(SaveSpan data, bool value) const {
+void Slot::setItemQuantities(SaveSpan data, std::span<const Items::ItemQuantity> quantities, DirtyRegions &dirty) const {
+    PROFILE_SCOPE("set items");
+    auto slot{SlotSection.bytesFrom(data)};
+    inventoryFrom(data);
+
+    for (const auto &[item, quantity] : quantities) {
+        size_t offset;
+        if (const auto entry{inventory->find(item)})
+            // If the item is already present we can just update the quantity
+            offset = entry->offset;
+        else {
+            // Otherwise we need to insert it into the free record after an existing item. This currently works, but only for a few items.
+            offset = inventory->allocate(slot);
+            dirty.mark(SlotSection.address + offset, item.data.size());
+            std::copy(item.data.begin(), item.data.end(), slot.begin() + offset);
+        }
+
+        const auto quantityOffset{offset + item.data.size()};
+        dirty.mark(SlotSection.address + quantityOffset, sizeof(u8));
+        slot[quantityOffset] = static_cast<u8>(quantity);
+        inventory->update(item, offset, static_cast<u8>(quantity));
+    }
+}
+
+void Slot::setActive(SaveSpan data, bool value, DirtyRegions &dirty) const {
+    dirty.mark(ActiveSection.address + index, sizeof(u8));
     ActiveSection.bytesFrom(data)[index] = value;
 }
 
@@ -137,12 +129,61 @@ u64 Slot::getLevel(SaveSpan data) const {
     return LevelSection.castInteger<u8>(data);
 }
 
-bool Slot::isActive(SaveSpan data, size_t slotIndex) const {
-    return static_cast<bool>(ActiveSection.bytesFrom(data)[slotIndex]);
+bool Slot::isActive(SaveSpan data) const {
+    return static_cast<bool>(ActiveSection.bytesFrom(data)[index]);
 }
 
-void SaveFile::validateData(SaveSpan data, std::string_view target) const {
-    if (HeaderBNDSection.stringFrom(data) != "BND" || data.size_bytes() != SaveFileSize)
+SlotSource::SlotSource(std::filesystem::path path, size_t slotIndex) : index{slotIndex} {
+    PROFILE_SCOPE("read slot", Slot::SlotSectionSize + Slot::SlotHeaderSectionSize);
+    const auto absolutePath{util::ToAbsolutePath(path).generic_string()};
+    if (slotIndex >= SaveFile::SlotCount)
+        throw exception("Invalid slot index {} while importing from '{}'", slotIndex, absolutePath);
+    if (!std::filesystem::exists(path))
+        throw exception("Path {} does not exist.", absolutePath);
+
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+        throw exception("Could not open file '{}'", absolutePath);
+    if (std::filesystem::file_size(path) != SaveFileSize || readSection(file, SaveFile::HeaderBNDSection, absolutePath) != std::vector<u8>{'B', 'N', 'D'})
+        throw exception("{} is not a valid Elden Ring save file.", absolutePath);
+
+    slotData = readSection(file, Slot::ParseSlot(Slot::SlotSectionOffset, Slot::SlotSectionSize, slotIndex), absolutePath);
+    headerData = readSection(file, Slot::ParseHeader(Slot::SlotHeaderSectionOffset, Slot::SlotHeaderSectionSize, slotIndex), absolutePath);
+    const auto steamIdData{readSection(file, SaveFile::SteamIdSection, absolutePath)};
+    std::memcpy(&sourceSteamId, steamIdData.data(), sizeof(u64));
+}
+
+std::vector<SlotSource> SlotSource::ReadAll(std::span<const Request> requests, size_t threads) {
+    PROFILE_SCOPE("read slots", requests.size() * (Slot::SlotSectionSize + Slot::SlotHeaderSectionSize));
+    if (requests.empty())
+        return {};
+    std::vector<std::future<SlotSource>> reads;
+    {
+        ThreadPool pool{std::min(threads ? threads : ThreadPool::DefaultThreadCount(), requests.size())};
+        for (const auto &request : requests)
+            reads.push_back(pool.submit([&request]() {
+                return SlotSource{request.path, request.slot};
+            }));
+    }
+
+    std::vector<SlotSource> sources;
+    sources.reserve(requests.size());
+    for (auto &read : reads)
+        sources.push_back(read.get());
+    return sources;
+}
+
+std::vector<u8> SlotSource::readSection(std::ifstream &file, const Section &section, std::string_view path) const {
+    std::vector<u8> buffer(section.size);
+    file.seekg(static_cast<std::streamoff>(section.address));
+    file.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(section.size));
+    if (!file)
+        throw exception("Failed to read 0x{:X} bytes at 0x{:X} from '{}'", section.size, section.address, path);
+    return buffer;
+}
+
+void SaveFile::validateData(std::span<u8> data, std::string_view target) const {
+    if (data.size_bytes() != SaveFileSize || HeaderBNDSection.stringFrom(data) != "BND")
         throw exception("{} is not a valid Elden Ring save file.", target);
 }
 
@@ -150,11 +191,198 @@ u64 SaveFile::steamId() const {
     return SteamIdSection.castInteger<u64>(saveData);
 }
 
-void SaveFile::debugListItems(int slotIndex) {
-    slots[slotIndex].debugListItems(saveData);
+void SaveFile::debugListItems(std::optional<size_t> slotIndex, fmt::memory_buffer *output) const {
+    std::vector<const Slot *> selected;
+    if (slotIndex)
+        selected.push_back(&slotAt(*slotIndex));
+    else
+        for (const auto &slot : slots)
+            selected.push_back(&slot);
+
+    size_t records{};
+    for (const auto slot : selected)
+        records += slot->inventoryFrom(saveData).allRecords().size();
+    Items::ItemCensus census{records};
+    for (const auto slot : selected)
+        slot->collectUnknownItems(saveData, census);
+
+    const auto entries{std::move(census).sorted()};
+    const auto location{[&slotIndex](const Items::ItemCensus::Location &location) {
+        return slotIndex ? fmt::format("0x{:06X}", location.offset) : fmt::format("slot {} 0x{:06X}", location.slot, location.offset);
+    }};
+    const auto print{[&](bool recognized) {
+        for (const auto &entry : entries) {
+            const auto group{items.hasGroup({0, entry.item})};
+            if (group.found != recognized)
+                continue;
+
+            const auto duplicates{entry.locations.size() > 1};
+            if (duplicates)
+                util::Print(output, "\n");
+            if (recognized)
+                util::Print(output, "{}: {}, id: {:02X}, quanity: {}\n", location(entry.locations.front()), group.name, entry.item.id, entry.quantity);
+            else
+                util::Print(output, "{}: group: {:02X}, id: {:02X}, quanity: {}\n", location(entry.locations.front()), entry.item.group, entry.item.id, entry.quantity);
+            if (duplicates) {
+                for (auto duplicate{entry.locations.begin() + 1}; duplicate != entry.locations.end(); duplicate++)
+                    util::Print(output, "    duplicate at {}\n", location(*duplicate));
+                util::Print(output, "\n");
+            }
+        }
+    }};
+
+    const auto recognizedCount{static_cast<size_t>(std::count_if(entries.begin(), entries.end(), [this](const Items::ItemCensus::Entry &entry) {
+        return items.hasGroup({0, entry.item}).found;
+    }))};
+    if (entries.size() > recognizedCount) {
+        util::Print(output, "found {} unique unknown items:\n\n", entries.size() - recognizedCount);
+        print(false);
+    }
+    if (recognizedCount) {
+        util::Print(output, "\nfound {} unknown items with a recognized group:\n\n", recognizedCount);
+        print(true);
+    }
+}
+
+void SaveFile::printDiff(const SaveFile &other, std::optional<size_t> slotIndex, fmt::memory_buffer *output) const {
+    constexpr static size_t MergeDistance{8}; //!< Ranges of the same section that are closer than this are listed as one
+    constexpr static size_t PreviewSize{16};  //!< The amount of bytes printed from the start of every range
+
+    if (slotIndex)
+        slotAt(*slotIndex);
+    const auto differences{util::FindDifferences(saveData, other.saveData)};
+    const auto layout{Layout()};
+
+    struct Change {
+        const NamedSection *section;
+        Section range;
+    };
+
+    // A difference is split at the boundaries of the sections it spans, the differences and the layout are both sorted so this is a single pass
+    std::vector<Change> changes;
+    auto section{layout.begin()};
+    for (const auto &difference : differences)
+        for (auto address{difference.address}; address < difference.length;) {
+            while (section->section.length <= address)
+                section++;
+            const auto end{std::min(difference.length, section->section.length)};
+            if (!slotIndex || section->slot == slotIndex) {
+                if (!changes.empty() && changes.back().section == &*section && address - changes.back().range.length < MergeDistance)
+                    changes.back().range = Section{changes.back().range.address, end - changes.back().range.address};
+                else
+                    changes.push_back({&*section, Section{address, end - address}});
+            }
+            address = end;
+        }
+
+    const auto preview{[](std::span<u8> bytes) {
+        std::string text;
+        for (size_t i{}; i < std::min(bytes.size(), PreviewSize); i++)
+            text += fmt::format("{}{:02X}", i ? " " : "", bytes[i]);
+        return bytes.size() > PreviewSize ? text + " ..." : text;
+    }};
+
+    const auto describeRecord{[this](std::span<u8> slot, size_t record) {
+        const Items::Item item{slot[record], slot[record + 1]};
+        const auto quantityOffset{record + item.data.size()};
+        if (quantityOffset >= slot.size() || slot[record + 2] != Items::ItemDelimiter.front() || slot[record + 3] != Items::ItemDelimiter.back())
+            return std::string{"no item"};
+        if (const auto entry{items.find(item)})
+            return fmt::format("{} x{}", entry->name, slot[quantityOffset]);
+        return fmt::format("group {:02X} id {:02X} x{}", item.group, item.id, slot[quantityOffset]);
+    }};
+
+    // Records of either save that overlap the range are listed, so removed and added items both show up
+    const auto printRecords{[&](size_t slotIndex, const Section &range) {
+        const auto &oldSlot{slots[slotIndex]};
+        const auto &newSlot{other.slots[slotIndex]};
+        const auto oldData{oldSlot.dataFrom(saveData)};
+        const auto newData{newSlot.dataFrom(other.saveData)};
+        const auto start{range.address - oldSlot.SlotSection.address};
+        const auto end{range.length - oldSlot.SlotSection.address};
+
+        std::vector<size_t> records;
+        for (const auto index : {&oldSlot.inventoryFrom(saveData).allRecords(), &newSlot.inventoryFrom(other.saveData).allRecords()})
+            for (auto record{std::lower_bound(index->begin(), index->end(), start >= Items::InventoryIndex::RecordSize ? start - Items::InventoryIndex::RecordSize + 1 : 0)}; record != index->end() && *record < end; record++)
+                records.push_back(*record);
+        std::sort(records.begin(), records.end());
+        records.erase(std::unique(records.begin(), records.end()), records.end());
+
+        for (const auto record : records) {
+            const auto before{describeRecord(oldData, record)};
+            const auto after{describeRecord(newData, record)};
+            if (before != after)
+                util::Print(output, "    item at 0x{:06X}: {} -> {}\n", record + 2, before, after); // Offsets are reported at the delimiter, like --debug-list-items
+        }
+    }};
+
+    size_t bytes{};
+    size_t sections{};
+    for (size_t i{}; i < changes.size(); i++) {
+        const auto &[named, range]{changes[i]};
+        if (!i || changes[i - 1].section != named)
+            sections++;
+        bytes += range.size;
+
+        util::Print(output, "0x{:07X} {:>6} bytes in {} at +0x{:X}: {} -> {}\n", range.address, range.size, named->name, range.address - named->section.address, preview(range.bytesFrom(saveData)), preview(range.bytesFrom(other.saveData)));
+        if (named->slot && named->section.address == slots[*named->slot].SlotSection.address)
+            printRecords(*named->slot, range);
+    }
+
+    if (changes.empty()) {
+        util::Print(output, "no differences found\n");
+        return;
+    }
+
+    util::Print(output, "\n");
+    if (!slotIndex && steamId() != other.steamId())
+        util::Print(output, "Steam ID: {} -> {}\n", steamId(), other.steamId());
+    for (const auto &slot : slots) {
+        if (slotIndex && slot.index != *slotIndex)
+            continue;
+
+        const auto &otherSlot{other.slots[slot.index]};
+        if (slot.isActive(saveData) != otherSlot.isActive(other.saveData))
+            util::Print(output, "slot {}: {} -> {}\n", slot.index, slot.isActive(saveData) ? "active" : "inactive", otherSlot.isActive(other.saveData) ? "active" : "inactive");
+
+        const auto &before{slot.metadataFrom(saveData)};
+        const auto &after{otherSlot.metadataFrom(other.saveData)};
+        if (before.name() != after.name())
+            util::Print(output, "slot {}: name '{}' -> '{}'\n", slot.index, before.name(), after.name());
+        if (before.level != after.level)
+            util::Print(output, "slot {}: level {} -> {}\n", slot.index, before.level, after.level);
+        if (before.timePlayed != after.timePlayed)
+            util::Print(output, "slot {}: played for {} -> {}\n", slot.index, before.timePlayed, after.timePlayed);
+    }
+    util::Print(output, "{} changed ranges, {} bytes in {} sections\n", changes.size(), bytes, sections);
+}
+
+SaveSpan SaveFile::loadFile(std::filesystem::path path, MappedFile::Mode mode) {
+    PROFILE_SCOPE("load", SaveFileSize);
+    std::span<u8> data;
+    if (!std::filesystem::exists(path))
+        throw exception("Path {} does not exist.", util::ToAbsolutePath(path).generic_string());
+    fileStatus = util::GetFileStatus(path); // Taken first, so a change while the file is being read is noticed by changedOnDisk()
+
+    if constexpr (MappedFile::Supported) {
+        try {
+            data = mappedFile.emplace(path, mode).bytes();
+        } catch (const exception &) {
+            mappedFile.reset(); // Fall back to reading the file, this might not be a regular file
+        }
+    }
+
+    if (!mappedFile) {
+        saveDataContainer = readFile(path);
+        data = saveDataContainer;
+    }
+
+    // This has to happen before the data is interpreted as a SaveSpan, its size is not guaranteed yet
+    validateData(data, util::ToAbsolutePath(path).generic_string());
+    return SaveSpan{data.data(), SaveFileSize};
 }
 
-std::vector<u8> SaveFile::loadFile(std::filesystem::path path) const {
+std::vector<u8> SaveFile::readFile(std::filesystem::path path) const {
     std::ifstream file(path, std::ios::in | std::ios::binary);
     std::vector<u8> buffer;
     if (!std::filesystem::exists(path))
@@ -167,40 +395,163 @@ std::vector<u8> SaveFile::loadFile(std::filesystem::path path) const {
     return buffer;
 }
 
-void SaveFile::write(SaveSpan data, std::filesystem::path path) const {
-    // TODO: Seems like this messes up slot names sometimes? Probably encoding related
-    std::ofstream file(path, std::ios::out | std::ios::binary);
-    if (!std::filesystem::exists(path))
-        throw exception("Path {} does not exist.", util::ToAbsolutePath(path).generic_string());
-    if (!file.is_open())
-        throw exception("Could not open file '{}'", util::ToAbsolutePath(path).generic_string());
+void SaveFile::write(std::filesystem::path path, bool inPlace) {
+    if (transaction)
+        throw exception("Cannot write '{}' while a transaction is open", util::ToAbsolutePath(path).generic_string());
+    if (batching)
+        applyBatch();
+    const auto overwritesSource{std::filesystem::exists(path) && std::filesystem::equivalent(path, loadedPath)};
+    if (overwritesSource && changedOnDisk())
+        throw exception("'{}' was changed by another program since it was loaded, writing it would discard those changes", util::ToAbsolutePath(path).generic_string());
+
+    if (inPlace && overwritesSource) {
+        validateData(saveData, "Generated data");
+        recalculateChecksums(saveData, dirty.empty());
+        util::WriteRanges(path, saveData, dirty.ranges());
+        dirty.clear();
+    } else
+        write(saveData, path);
+
+    if (overwritesSource) {
+        fileChecksums = storedChecksums();
+        fileStatus = util::GetFileStatus(path);
+    }
+}
 
+void SaveFile::write(SaveSpan data, std::filesystem::path path) {
+    PROFILE_SCOPE("write", SaveFileSize);
     validateData(data, "Generated data");
-    recalculateChecksums(data);
-    file.write(reinterpret_cast<const char *>(data.data()), data.size_bytes());
+
+    std::vector<Section> checksumSections{SaveHeaderChecksumSection};
+    for (const auto &slot : slots)
+        checksumSections.push_back(slot.checksumSection());
+    std::sort(checksumSections.begin(), checksumSections.end(), [](const Section &a, const Section &b) {
+        return a.address < b.address;
+    });
+
+    // Everything but the checksums is written while they are calculated, the hashed regions and the written ones are both only read.
+    // With a single checksum thread the hashing is deferred to the calling thread instead, after the data was written
+    auto checksums{std::async(checksumThreads == 1 ? std::launch::deferred : std::launch::async, [this, data, all{dirty.empty()}]() {
+        recalculateChecksums(data, all);
+    })};
+
+    util::AtomicFile file{path};
+    size_t offset{};
+    for (const auto &section : checksumSections) {
+        file.write(data.subspan(offset, section.address - offset), offset);
+        offset = section.length;
+    }
+    file.write(data.subspan(offset), offset);
+
+    checksums.get();
+    for (const auto &section : checksumSections)
+        file.write(section.bytesFrom(data), section.address);
+    file.commit();
+    dirty.clear();
+}
+
+std::vector<BackupStore::Range> SaveFile::BackupChunks() {
+    std::vector<BackupStore::Range> chunks;
+    const auto addUntil{[&chunks](size_t address) {
+        const auto end{chunks.empty() ? 0 : chunks.back().section.length};
+        if (address > end)
+            chunks.push_back({Section{end, address - end}});
+    }};
+
+    for (size_t i{}; i < SlotCount; i++) {
+        const auto checksum{Slot::ParseSlot(Slot::SlotChecksumSectionOffset, Slot::SlotChecksumSectionSize, i)};
+        addUntil(checksum.address);
+        chunks.push_back({checksum});
+        chunks.push_back({Slot::ParseSlot(Slot::SlotSectionOffset, Slot::SlotSectionSize, i), checksum});
+    }
+    addUntil(SaveHeaderChecksumSection.address);
+    chunks.push_back({SaveHeaderChecksumSection});
+    chunks.push_back({SaveHeaderSection, SaveHeaderChecksumSection});
+    addUntil(SaveFileSize);
+    return chunks;
+}
+
+std::vector<SaveFile::NamedSection> SaveFile::Layout() {
+    std::vector<NamedSection> layout;
+    const auto add{[&layout](std::string name, const Section &section, std::optional<size_t> slot = std::nullopt) {
+        layout.push_back({std::move(name), section, slot});
+    }};
+    const auto addUntil{[&layout, &add](size_t address, std::string_view name, std::optional<size_t> slot = std::nullopt) {
+        const auto end{layout.empty() ? 0 : layout.back().section.length};
+        if (address > end)
+            add(std::string{name}, Section{end, address - end}, slot);
+    }};
+
+    for (size_t i{}; i < SlotCount; i++) {
+        const Slot slot{i};
+        addUntil(slot.SlotChecksumSection.address, "file header");
+        add(fmt::format("slot {} checksum", i), slot.SlotChecksumSection, i);
+        add(fmt::format("slot {} data", i), slot.SlotSection, i);
+    }
+    addUntil(SaveHeaderChecksumSection.address, "file header");
+    add("save header checksum", SaveHeaderChecksumSection);
+
+    addUntil(SteamIdSection.address, "save header");
+    add("Steam ID", SteamIdSection);
+    addUntil(Slot::ActiveSection.address, "save header");
+    for (size_t i{}; i < SlotCount; i++)
+        add(fmt::format("slot {} active", i), Section{Slot::ActiveSection.address + i, 1}, i);
+
+    for (size_t i{}; i < SlotCount; i++) {
+        const Slot slot{i};
+        const auto header{fmt::format("slot {} header", i)};
+        addUntil(slot.SlotHeaderSection.address, "save header");
+        add(fmt::format("slot {} name", i), slot.NameSection, i);
+        addUntil(slot.LevelSection.address, header, i);
+        add(fmt::format("slot {} level", i), slot.LevelSection, i);
+        addUntil(slot.SecondsPlayedSection.address, header, i);
+        add(fmt::format("slot {} seconds played", i), slot.SecondsPlayedSection, i);
+        addUntil(slot.SlotHeaderSection.length, header, i);
+    }
+    addUntil(SaveHeaderSection.length, "save header");
+    addUntil(SaveFileSize, "file tail");
+    return layout;
 }
 
-const std::vector<Slot> SaveFile::parseSlots(SaveSpan data) const {
+std::vector<Slot> SaveFile::CreateSlots() {
     std::vector<Slot> buffer;
+    buffer.reserve(SlotCount);
     for (size_t i{}; i < SlotCount; i++)
-        buffer.push_back(Slot{data, i});
+        buffer.emplace_back(i);
 
     return buffer;
 }
 
-void SaveFile::refreshSlots() {
-    auto newSlots{parseSlots(saveData)};
-    slots.swap(newSlots);
+void SaveFile::invalidateSlots(std::span<const size_t> matches, size_t size) {
+    for (const auto match : matches)
+        for (const auto &slot : slots)
+            slot.invalidate(Section{match, size});
+}
+
+const Slot &SaveFile::slotAt(size_t slotIndex) const {
+    if (slotIndex >= SlotCount)
+        throw exception("Invalid slot index {}", slotIndex);
+    return slots[slotIndex];
 }
 
 void SaveFile::copySlot(SaveFile &source, size_t sourceSlotIndex, size_t targetSlotIndex) {
-    if (targetSlotIndex > SlotCount || sourceSlotIndex > SlotCount)
+    if (targetSlotIndex >= SlotCount || sourceSlotIndex >= SlotCount)
         throw exception("Invalid slot index while copying character");
 
-    source.slots[sourceSlotIndex].copy(source.saveData, saveData, targetSlotIndex);
-    replaceSteamId(source.saveData, steamId());
+    source.slots[sourceSlotIndex].copy(source.saveData, saveData, targetSlotIndex, dirty);
+    slots[targetSlotIndex].invalidate();
+    replaceSteamId(source.steamId(), targetSteamId());
+    setSlotActivity(targetSlotIndex, true);
+}
+
+void SaveFile::copySlot(SlotSource &source, size_t targetSlotIndex) {
+    if (targetSlotIndex >= SlotCount)
+        throw exception("Invalid slot index while copying character");
+
+    Slot::CopyInto(source.slotBytes(), source.headerBytes(), saveData, targetSlotIndex, dirty);
+    slots[targetSlotIndex].invalidate();
+    replaceSteamId(source.steamId(), targetSteamId());
     setSlotActivity(targetSlotIndex, true);
-    refreshSlots();
 }
 
 void SaveFile::copySlot(size_t sourceSlotIndex, size_t targetSlotIndex) {
@@ -209,16 +560,15 @@ void SaveFile::copySlot(size_t sourceSlotIndex, size_t targetSlotIndex) {
 
 void SaveFile::appendSlot(SaveFile &source, size_t sourceSlotIndex) {
     size_t firstAvailableSlot{SlotCount + 1};
-    for (auto &slot : slots)
-        if (!slot.active) {
+    for (const auto &slot : slots)
+        if (!slot.isActive(saveData)) {
             firstAvailableSlot = slot.index;
             break;
         }
 
     if (firstAvailableSlot == SlotCount + 1)
         throw exception("Could not find an unactive slot to append slot {} to", sourceSlotIndex);
-    copySlot(source, sourceSlotIndex, firstAvailableSlot);
-    setSlotActivity(firstAvailableSlot, true);
+    copySlot(source, sourceSlotIndex, firstAvailableSlot); // This also activates the slot
 }
 
 void SaveFile::appendSlot(size_t sourceSlotIndex) {
@@ -226,61 +576,382 @@ void SaveFile::appendSlot(size_t sourceSlotIndex) {
 }
 
 void SaveFile::renameSlot(size_t slotIndex, std::string_view name) {
-    if (slotIndex > SlotCount)
+    if (slotIndex >= SlotCount)
         throw exception("Invalid slot index while renaming character");
 
-    slots[slotIndex].rename(saveData, name);
-    refreshSlots();
+    replaceEverywhere(slotAt(slotIndex).renameReplacement(saveData, name));
 }
 
-void SaveFile::replaceSteamId(SaveSpan replaceFrom, u64 newSteamId) const {
+void SaveFile::replaceSteamId(u64 oldSteamId, u64 newSteamId) {
+    if (oldSteamId == newSteamId)
+        return;
+
+    std::array<u8, sizeof(u64)> oldSteamIdData{};
     std::array<u8, sizeof(u64)> steamIdData{};
+    std::memcpy(oldSteamIdData.data(), &oldSteamId, sizeof(u64));
     std::memcpy(steamIdData.data(), &newSteamId, sizeof(u64));
-    util::ReplaceAll<u8>(saveData, SteamIdSection.bytesFrom(replaceFrom), steamIdData);
+    replaceEverywhere({oldSteamIdData, steamIdData});
 }
 
-void SaveFile::replaceSteamId(u64 newSteamId) const {
-    replaceSteamId(saveData, newSteamId);
+void SaveFile::replaceEverywhere(util::Replacement replacement) {
+    if (batching) {
+        pendingReplacements.push_back(std::move(replacement));
+        return;
+    }
+
+    PROFILE_SCOPE("replace", SaveFileSize);
+    // The pattern could be anywhere, so only the slots it was actually found in are invalidated
+    const auto matches{util::ReplaceAll(saveData, std::span{&replacement, 1}, &dirty)};
+    invalidateSlots(matches, replacement.find.size());
+}
+
+std::vector<size_t> SaveFile::applyBatch() {
+    batching = false;
+    batchSteamId.reset();
+    if (pendingReplacements.empty())
+        return {};
+
+    PROFILE_SCOPE("replace", SaveFileSize);
+    const auto matches{util::ReplaceAll(saveData, pendingReplacements, &dirty)};
+    const auto largest{std::max_element(pendingReplacements.begin(), pendingReplacements.end(), [](const util::Replacement &a, const util::Replacement &b) {
+        return a.find.size() < b.find.size();
+    })};
+    invalidateSlots(matches, largest->find.size());
+    pendingReplacements.clear();
+    return matches;
+}
+
+std::vector<SaveFile::ChecksumRange> SaveFile::ChecksumRanges() {
+    std::vector<ChecksumRange> ranges;
+    ranges.reserve(SlotCount + 1);
+    for (size_t i{}; i < SlotCount; i++) {
+        const Slot slot{i};
+        ranges.push_back({slot.SlotChecksumSection, slot.SlotSection, i});
+    }
+    ranges.push_back({SaveHeaderChecksumSection, SaveHeaderSection, std::nullopt});
+    return ranges;
 }
 
-void SaveFile::recalculateChecksums(SaveSpan data) const {
-    auto saveHeaderChecksum{util::GenerateMd5(SaveHeaderSection.bytesFrom(data))};
-    SaveHeaderChecksumSection.replace(data, saveHeaderChecksum);
+SaveFile::Checksums SaveFile::storedChecksums() const {
+    Checksums checksums{};
+    const auto ranges{ChecksumRanges()};
+    for (size_t i{}; i < ranges.size(); i++) {
+        const auto stored{ranges[i].checksum.bytesFrom(saveData)};
+        std::copy(stored.begin(), stored.end(), checksums[i].begin());
+    }
+    return checksums;
+}
+
+std::vector<size_t> SaveFile::findChangedRanges(const util::FileStatus &status) const {
+    if (status.size != SaveFileSize)
+        throw exception("{} is not a valid Elden Ring save file.", util::ToAbsolutePath(loadedPath).generic_string());
+
+    std::vector<Section> checksumSections;
+    for (const auto &range : ChecksumRanges())
+        checksumSections.push_back(range.checksum);
+    const auto checksums{util::ReadRanges(loadedPath, checksumSections)};
+
+    // The file is compared against the checksums it had, since the pages of a mapping that were never written to follow the file
+    std::vector<size_t> changed;
+    for (size_t i{}; i < fileChecksums.size(); i++)
+        if (!std::equal(fileChecksums[i].begin(), fileChecksums[i].end(), checksums.begin() + static_cast<std::ptrdiff_t>(i * fileChecksums[i].size())))
+            changed.push_back(i);
+    return changed;
+}
+
+bool SaveFile::changedOnDisk() {
+    const auto status{util::GetFileStatus(loadedPath)};
+    if (status == fileStatus)
+        return false;
+    if (!findChangedRanges(status).empty())
+        return true;
+    fileStatus = status; // The file was written without changing any checksum, so the next check is a single stat again
+    return false;
+}
+
+SaveFile::Reload SaveFile::reloadChanged() {
+    PROFILE_SCOPE("reload");
+    if (transaction)
+        throw exception("Cannot reload '{}' while a transaction is open", util::ToAbsolutePath(loadedPath).generic_string());
+    const auto status{util::GetFileStatus(loadedPath)};
+    const auto changed{findChangedRanges(status)};
+    const auto ranges{ChecksumRanges()};
+
+    std::vector<Section> sections;
+    for (const auto i : changed) {
+        if (dirty.touches(ranges[i].data) || dirty.touches(ranges[i].checksum))
+            throw exception("'{}' changed on disk while {} has unsaved changes", util::ToAbsolutePath(loadedPath).generic_string(), ranges[i].slot ? fmt::format("slot {}", *ranges[i].slot) : std::string{"the save header"});
+        sections.push_back(ranges[i].checksum);
+        sections.push_back(ranges[i].data);
+    }
+    const auto contents{util::ReadRanges(loadedPath, sections)};
+
+    // The ranges are copied without marking them dirty, they are the same as the file now
+    auto source{contents.begin()};
+    for (const auto &section : sections) {
+        std::copy_n(source, section.size, section.bytesFrom(saveData).begin());
+        source += static_cast<std::ptrdiff_t>(section.size);
+        for (const auto &slot : slots)
+            slot.invalidate(section);
+    }
+    if (!sections.empty()) {
+        undoHistory.clear();
+        undoHistorySize = 0;
+    }
+
+    Reload reload;
+    for (const auto i : changed) {
+        std::copy_n(ranges[i].checksum.bytesFrom(saveData).begin(), fileChecksums[i].size(), fileChecksums[i].begin());
+        if (ranges[i].slot)
+            reload.slots.push_back(*ranges[i].slot);
+        else
+            reload.header = true;
+    }
+    fileStatus = status;
+    return reload;
+}
+
+void SaveFile::begin() {
+    if (transaction)
+        throw exception("A transaction is already open");
+    transaction.emplace(Transaction{PageSnapshot{saveData}, batching, pendingReplacements, batchSteamId});
+    dirty.record(&transaction->pages);
+}
+
+void SaveFile::commit() {
+    if (!transaction)
+        throw exception("No transaction is open");
+    dirty.record(nullptr);
+    undoHistorySize += transaction->pages.size();
+    undoHistory.push_back(std::move(*transaction));
+    transaction.reset();
+
+    while (undoHistorySize > UndoHistoryLimit) {
+        undoHistorySize -= undoHistory.front().pages.size();
+        undoHistory.pop_front();
+    }
+}
+
+void SaveFile::rollback() {
+    if (!transaction)
+        throw exception("No transaction is open");
+    dirty.record(nullptr);
+    restore(*transaction);
+    transaction.reset();
+}
+
+bool SaveFile::undo() {
+    if (transaction)
+        throw exception("Cannot undo while a transaction is open");
+    if (undoHistory.empty())
+        return false;
+    restore(undoHistory.back());
+    undoHistorySize -= undoHistory.back().pages.size();
+    undoHistory.pop_back();
+    return true;
+}
+
+void SaveFile::restore(const Transaction &undone) {
+    PROFILE_SCOPE("rollback", undone.pages.size());
+    const auto &restored{undone.pages.restore()};
+    for (const auto &section : restored)
+        for (const auto &slot : slots)
+            slot.invalidate(section);
+
+    // The restored ranges are modified on top of anything else that is, edits made outside of the transaction keep their checksums up to date
+    for (const auto &section : restored)
+        dirty.mark(section);
+    batching = undone.batching;
+    pendingReplacements = undone.pendingReplacements;
+    batchSteamId = undone.batchSteamId;
+}
+
+SaveFile::Reload SaveFile::mergeChangesOnDisk() {
+    if (!changedOnDisk())
+        return {};
+    return reloadChanged();
+}
+
+SaveFile::Verification SaveFile::verify(bool stopAtFirstMismatch) const {
+    PROFILE_SCOPE("verify", SlotCount * Slot::SlotSectionSize + SaveHeaderSection.size);
+    const auto ranges{ChecksumRanges()};
+    std::atomic<bool> mismatch{};
+
+    // Hash the ranges [begin, end) together, or nothing if a mismatch was already found and the rest should be skipped
+    const auto check{[this, &ranges, &mismatch, stopAtFirstMismatch](size_t begin, size_t end) -> std::optional<std::vector<size_t>> {
+        if (stopAtFirstMismatch && mismatch)
+            return std::nullopt;
+        std::vector<std::span<u8>> data;
+        for (auto i{begin}; i < end; i++)
+            data.push_back(ranges[i].data.bytesFrom(saveData));
+
+        const auto checksums{util::GenerateMd5(data)};
+        std::vector<size_t> mismatched;
+        for (auto i{begin}; i < end; i++) {
+            const auto stored{ranges[i].checksum.bytesFrom(saveData)};
+            if (!std::equal(stored.begin(), stored.end(), checksums[i - begin].begin()))
+                mismatched.push_back(i);
+        }
+        if (!mismatched.empty())
+            mismatch = true;
+        return mismatched;
+    }};
+
+    // The header is the smallest range so it is checked first, the slots are all the same size and get hashed in groups by the multi-buffer hasher
+    ThreadPool pool{std::min(checksumThreads ? checksumThreads : ThreadPool::DefaultThreadCount(), SlotCount + 1)};
+    std::vector<std::future<std::optional<std::vector<size_t>>>> results;
+    results.push_back(pool.submit([&check]() {
+        return check(SlotCount, SlotCount + 1);
+    }));
+    const auto perThread{(SlotCount + pool.size() - 1) / pool.size()};
+    const auto groupSize{stopAtFirstMismatch ? std::min(perThread, FastVerifyGroup) : perThread};
+    for (size_t begin{}; begin < SlotCount; begin += groupSize)
+        results.push_back(pool.submit([&check, begin, groupSize]() {
+            return check(begin, std::min(begin + groupSize, SlotCount));
+        }));
+
+    Verification verification;
+    for (auto &result : results) {
+        const auto mismatched{result.get()};
+        if (!mismatched) {
+            verification.complete = false;
+            continue;
+        }
+        for (const auto i : *mismatched)
+            if (ranges[i].slot)
+                verification.corruptSlots.push_back(*ranges[i].slot);
+            else
+                verification.corruptHeader = true;
+    }
+    return verification;
+}
+
+std::string SaveFile::Verification::describe() const {
+    if (valid())
+        return "all checksums match";
+
+    std::string description;
+    for (const auto slot : corruptSlots)
+        description += fmt::format("{}slot {}", description.empty() ? "checksum mismatch in " : ", ", slot);
+    if (corruptHeader)
+        description += description.empty() ? "checksum mismatch in the save header" : " and the save header";
+    if (!complete)
+        description += ", stopped at the first mismatch";
+    return description;
+}
+
+std::string SaveFile::Reload::describe() const {
+    if (empty())
+        return "nothing changed";
+
+    std::string description;
+    for (const auto slot : slots)
+        description += fmt::format("{}slot {}", description.empty() ? "reloaded " : ", ", slot);
+    if (header)
+        description += description.empty() ? "reloaded the save header" : " and the save header";
+    return description;
+}
+
+void SaveFile::replaceSteamId(u64 newSteamId) {
+    replaceSteamId(targetSteamId(), newSteamId);
+    if (batching)
+        batchSteamId = newSteamId;
+}
+
+void SaveFile::recalculateChecksums(SaveSpan data, bool all) {
+    const auto headerDirty{all || dirty.touches(SaveHeaderSection)};
+    std::vector<const Slot *> dirtySlots;
     for (auto &slot : slots)
-        slot.recalculateSlotChecksum(data);
+        if (all || slot.isDirty(dirty))
+            dirtySlots.push_back(&slot);
+
+    const auto regionCount{dirtySlots.size() + headerDirty};
+    if (!regionCount)
+        return;
+    PROFILE_SCOPE("checksums", dirtySlots.size() * Slot::SlotSectionSize + (headerDirty ? SaveHeaderSection.size : 0));
+
+    // The regions do not overlap with each other or with any checksum, so they can be hashed concurrently.
+    // Only the hashing happens on the pool, the results are stored afterwards as DirtyRegions is not thread-safe
+    ThreadPool pool{std::min(checksumThreads ? checksumThreads : ThreadPool::DefaultThreadCount(), regionCount)};
+    std::future<util::Md5Hash> headerChecksum;
+    if (headerDirty)
+        headerChecksum = pool.submit([this, data]() {
+            return util::GenerateMd5(SaveHeaderSection.bytesFrom(data));
+        });
+
+    // The slots are all the same size, so each thread hashes its share of them together using the multi-buffer hasher
+    std::vector<std::span<u8>> slotData;
+    for (auto slot : dirtySlots)
+        slotData.emplace_back(slot->dataFrom(data));
+
+    std::vector<std::future<std::vector<util::Md5Hash>>> slotChecksums;
+    const auto batchCount{std::min(pool.size(), slotData.size())};
+    for (size_t batch{}; batch < batchCount; batch++) {
+        const auto begin{(batch * slotData.size()) / batchCount};
+        const auto end{((batch + 1) * slotData.size()) / batchCount};
+        slotChecksums.emplace_back(pool.submit([batch{std::span<const std::span<u8>>{slotData}.subspan(begin, end - begin)}]() {
+            return util::GenerateMd5(batch);
+        }));
+    }
+
+    if (headerDirty) {
+        auto checksum{headerChecksum.get()};
+        SaveHeaderChecksumSection.replace(data, checksum, dirty);
+    }
+
+    size_t slotIndex{};
+    for (auto &batch : slotChecksums)
+        for (auto &checksum : batch.get())
+            dirtySlots[slotIndex++]->storeChecksum(data, checksum, dirty);
 }
 
 void SaveFile::setSlotActivity(size_t slotIndex, bool active) {
-    slots[slotIndex].setActive(saveData, active);
-    refreshSlots();
+    slotAt(slotIndex).setActive(saveData, active, dirty);
+}
+
+bool SaveFile::isSlotActive(size_t slotIndex) const {
+    return slotAt(slotIndex).isActive(saveData);
+}
+
+const Slot::Metadata &SaveFile::slotMetadata(size_t slotIndex) const {
+    return slotAt(slotIndex).metadataFrom(saveData);
 }
 
 u32 SaveFile::getItem(size_t slot, Items::Item item) const {
-    return slots[slot].getItemQuantity(saveData, item);
+    return slotAt(slot).getItemQuantity(saveData, item);
+}
+
+void SaveFile::setItem(size_t slot, Items::Item item, u32 quantity) {
+    slotAt(slot).setItemQuantity(saveData, item, quantity, dirty);
+}
+
+void SaveFile::setItems(size_t slot, std::span<const Items::ItemQuantity> quantities) {
+    slotAt(slot).setItemQuantities(saveData, quantities, dirty);
 }
 
-void SaveFile::setItem(size_t slot, Items::Item item, u32 quantity) const {
-    slots[slot].setItemQuantity(saveData, item, quantity);
+std::vector<Items::ItemRecord> SaveFile::itemRecords(size_t slotIndex) const {
+    return slotAt(slotIndex).itemRecords(saveData);
 }
 
-void SaveFile::printActiveSlots() const {
-    for (auto slot : slots)
-        if (slot.active)
-            printSlot(slot.index);
+void SaveFile::printActiveSlots(fmt::memory_buffer *output) const {
+    for (const auto &slot : slots)
+        if (slot.isActive(saveData))
+            printSlot(slot.index, output);
 }
 
-void SaveFile::printSlot(size_t slotIndex) const {
-    const auto slot{slots[slotIndex]};
-    if (!slot.active)
-        fmt::print("warning: slot {} is not active\n", slotIndex);
-    fmt::print("slot {}: {}, level {}, played for {}\n", slotIndex, slot.name, slot.level, slot.timePlayed);
+void SaveFile::printSlot(size_t slotIndex, fmt::memory_buffer *output) const {
+    const auto &slot{slotAt(slotIndex)};
+    if (!slot.isActive(saveData))
+        util::Print(output, "warning: slot {} is not active\n", slotIndex);
+    const auto &metadata{slot.metadataFrom(saveData)};
+    util::Print(output, "slot {}: {}, level {}, played for {}\n", slotIndex, metadata.name(), metadata.level, metadata.timePlayed);
 }
 
-void SaveFile::printItems(size_t slotIndex) const {
-    const auto slot{slots[slotIndex]};
-    if (!slot.active)
-        fmt::print("warning: slot {} is not active\n", slotIndex);
-    for (auto item : items)
-        if (getItem(slotIndex, item.second))
-            fmt::print("{}: {}\n", item.first, getItem(slotIndex, item.second));
+void SaveFile::printItems(size_t slotIndex, fmt::memory_buffer *output) const {
+    const auto &slot{slotAt(slotIndex)};
+    if (!slot.isActive(saveData))
+        util::Print(output, "warning: slot {} is not active\n", slotIndex);
+    for (const auto &entry : items)
+        if (const auto quantity{getItem(slotIndex, entry.item)})
+            util::Print(output, "{}: {}\n", entry.name, quantity);
 }
@@ -1,10 +1,18 @@
+#include "../backup.h"
+#include "../mappedfile.h"
+#include "inventory.h"
 #include "items.h"
+#include <deque>
 #include <filesystem>
+#include <fstream>
+#include <optional>
 #include <span>
 #include <vector>
 #include <string>
 #include <vector>
 
+#pragma once
+
 constexpr static size_t SaveFileSize = 0x1BA03D0; //!< The size of an Elden Ring save file
 using SaveSpan = std::span<u8, SaveFileSize>;     //!< A span of the save file
 
@@ -15,26 +23,35 @@ class Slot {
   public:
     const size_t index; //!< The index of the save slot, each character has a unique slot. This value can range between 0-9
   private:
+    friend class SlotSource;
+    friend class SaveFile;
+    friend class Benchmark;
+    friend class SaveGenerator;
+
     /**
      * @brief Used to calculate a target address when copying a character
      */
     constexpr static const size_t SlotSectionOffset{0x310};
+    constexpr static const size_t SlotSectionSize{0x280000};
+    constexpr static const size_t SlotChecksumSectionOffset{0x300};
+    constexpr static const size_t SlotChecksumSectionSize{0x10};
     constexpr static const size_t SlotHeaderSectionOffset{0x1901D0E};
+    constexpr static const size_t SlotHeaderSectionSize{0x24C};
     constexpr static const size_t NameSectionSize{0x22};
 
-    constexpr static Section ActiveSection{0x1901D04, 0xA};                       //!< Contains booleans indicating if the character at address + slotIndex is active
-    const Section SlotSection{ParseSlot(SlotSectionOffset, 0x280000)};            //!< Contains the save data of the character
-    const Section SlotChecksumSection{ParseSlot(0x300, 0x10)};                    //!< Contains the checksum of the data section
-    const Section SlotHeaderSection{ParseHeader(SlotHeaderSectionOffset, 0x24C)}; //!< Contains the slots header
-    const Section NameSection{ParseHeader(0x1901D0E, NameSectionSize)};           //!< Contains the name of a character, without slot index parsing
-    const Section LevelSection{ParseHeader(0x1901D30, 0x1)};                      //!< Contains the level of the character
-    const Section SecondsPlayedSection{ParseHeader(0x1901D34, 0x4)};              //!< Contains the number of seconds played
+    constexpr static Section ActiveSection{0x1901D04, 0xA};                                       //!< Contains booleans indicating if the character at address + slotIndex is active
+    const Section SlotSection{ParseSlot(SlotSectionOffset, SlotSectionSize)};                     //!< Contains the save data of the character
+    const Section SlotChecksumSection{ParseSlot(SlotChecksumSectionOffset, SlotChecksumSectionSize)}; //!< Contains the checksum of the data section
+    const Section SlotHeaderSection{ParseHeader(SlotHeaderSectionOffset, SlotHeaderSectionSize)}; //!< Contains the slots header
+    const Section NameSection{ParseHeader(0x1901D0E, NameSectionSize)};                           //!< Contains the name of a character, without slot index parsing
+    const Section LevelSection{ParseHeader(0x1901D30, 0x1)};                                      //!< Contains the level of the character
+    const Section SecondsPlayedSection{ParseHeader(0x1901D34, 0x4)};                              //!< Contains the number of seconds played
 
     /**
      * @brief A wrapper around Section that provides the offsets for a save header
      */
-    constexpr Section ParseHeader(size_t address, size_t size, size_t slotIndex) const {
-        return Section{address + (slotIndex * SlotHeaderSection.size), size};
+    constexpr static Section ParseHeader(size_t address, size_t size, size_t slotIndex) {
+        return Section{address + (slotIndex * SlotHeaderSectionSize), size};
     }
 
     constexpr Section ParseHeader(size_t address, size_t size) const {
@@ -44,29 +61,76 @@ class Slot {
     /**
      * @brief A wrapper around Section that provides the offsets for a save slot
      */
-    constexpr Section ParseSlot(size_t address, size_t size, size_t slotIndex) const {
-        return Section{address + (slotIndex * 0x10) + (slotIndex * SlotSection.size), size};
+    constexpr static Section ParseSlot(size_t address, size_t size, size_t slotIndex) {
+        return Section{address + (slotIndex * 0x10) + (slotIndex * SlotSectionSize), size};
     }
 
     constexpr Section ParseSlot(size_t address, size_t size) const {
         return ParseSlot(address, size, index);
     }
 
-    bool isActive(SaveSpan data, size_t slotIndex) const;
+  public:
+    /**
+     * @brief The values parsed from the slots header
+     */
+    struct Metadata {
+        u64 level;                                                           //!< The level of the character
+        std::array<char, util::Utf8Capacity(NameSectionSize)> nameBuffer{}; //!< The UTF-8 name of the character, see name()
+        size_t nameSize{};
+        std::string timePlayed; //!< A timestamp of the characters play time
+
+        /**
+         * @brief The name of the character, without the padding of the name section
+         */
+        std::string_view name() const {
+            return {nameBuffer.data(), nameSize};
+        }
+    };
 
-    std::string getName(SaveSpan data) const;
+  private:
+    mutable std::optional<Items::InventoryIndex> inventory; //!< The index of the items in the slot, built on first use
+    mutable std::optional<Metadata> metadata;               //!< The parsed header of the slot, built on first use
 
     std::string getTimePlayed(SaveSpan data) const;
 
     u64 getLevel(SaveSpan data) const;
 
   public:
-    bool active;            //!< Whether the save slot is currently in use
-    u64 level;              //!< The level of the character
-    std::string name;       //!< The name of the character
-    std::string timePlayed; //!< A timestamp of the characters play time
+    explicit Slot(size_t slotIndex) : index{slotIndex} {}
 
-    constexpr Slot(SaveSpan data, size_t slotIndex) : index{slotIndex}, active{isActive(data, slotIndex)}, level{getLevel(data)}, name{getName(data)}, timePlayed{getTimePlayed(data)} {}
+    /**
+     * @brief Check if the save slot is currently in use
+     * @note This is read from the data every time, so changing it does not invalidate the slot
+     */
+    bool isActive(SaveSpan data) const;
+
+    /**
+     * @brief Get the parsed header of the slot, parsing it if needed
+     */
+    const Metadata &metadataFrom(SaveSpan data) const;
+
+    /**
+     * @brief Discard everything parsed from the given range, this must be called if it was modified outside of this class
+     */
+    void invalidate(const Section &modified) const {
+        if (modified.overlaps(SlotSection))
+            inventory.reset();
+        if (modified.overlaps(SlotHeaderSection))
+            metadata.reset();
+    }
+
+    /**
+     * @brief Discard everything parsed from the slot
+     */
+    void invalidate() const {
+        inventory.reset();
+        metadata.reset();
+    }
+
+    /**
+     * @brief Copy a slots data and header into the given slot of the target span
+     */
+    static void CopyInto(std::span<u8> slotData, std::span<u8> headerData, SaveSpan target, size_t targetSlotIndex, DirtyRegions &dirty);
 
     /**
      * @brief Copy the currently active save slot into the given span
@@ -74,86 +138,437 @@ class Slot {
      * @param target The span to copy the save slot to
      * @param targetSlotIndex The index of the source save slot to copy
      */
-    void copy(SaveSpan source, SaveSpan target, size_t targetSlotIndex) const;
+    void copy(SaveSpan source, SaveSpan target, size_t targetSlotIndex, DirtyRegions &dirty) const;
+
+    /**
+     * @brief Get the slots save data, which its checksum is calculated from
+     */
+    std::span<u8> dataFrom(SaveSpan data) const {
+        return SlotSection.bytesFrom(data);
+    }
+
+    const Section &checksumSection() const {
+        return SlotChecksumSection;
+    }
+
+    /**
+     * @brief Replace the stored checksum of the slot
+     */
+    void storeChecksum(SaveSpan data, util::Md5Hash checksum, DirtyRegions &dirty) const;
+
+    /**
+     * @brief Check if the slots data was modified since the last write
+     */
+    bool isDirty(const DirtyRegions &dirty) const {
+        return dirty.touches(SlotSection);
+    }
+
+    /**
+     * @brief Add every record of an item that is not in the catalog to the census
+     */
+    void collectUnknownItems(SaveSpan data, Items::ItemCensus &census) const;
 
     /**
-     * @brief Recalculate and replace the checksum of the currently active save slot
+     * @brief Get every record in the slot that holds an item, known or not, in the order they are stored
      */
-    void recalculateSlotChecksum(SaveSpan data) const;
+    std::vector<Items::ItemRecord> itemRecords(SaveSpan data) const;
 
     /**
-     * @brief List all items that could not yet be properly parsed
+     * @brief Get the index of all items in the slot, building it if needed
      */
-    void debugListItems(SaveSpan data);
+    const Items::InventoryIndex &inventoryFrom(SaveSpan data) const;
 
     u32 getItemQuantity(SaveSpan data, Items::Item item) const;
 
-    void setItemQuantity(SaveSpan data, Items::Item item, u32 quantity) const;
+    void setItemQuantity(SaveSpan data, Items::Item item, u32 quantity, DirtyRegions &dirty) const;
 
-    void setActive(SaveSpan data, bool active) const;
+    /**
+     * @brief Set the quantities of many items at once, the index is built once and new items take the next entry of its free list
+     * @note An item that appears more than once ends up with its last quantity
+     */
+    void setItemQuantities(SaveSpan data, std::span<const Items::ItemQuantity> quantities, DirtyRegions &dirty) const;
+
+    void setActive(SaveSpan data, bool active, DirtyRegions &dirty) const;
 
-    void rename(SaveSpan data, std::string_view newName) const;
+    /**
+     * @brief Get the replacement that renames this character, its old name is replaced everywhere in the save
+     */
+    util::Replacement renameReplacement(SaveSpan data, std::string_view newName) const;
+};
+
+/**
+ * @brief A read-only view of a single slot in a save file, used as the source when importing a character
+ * @note Only the ranges needed to copy the slot are read from the file, the rest of it is never loaded
+ */
+class SlotSource {
+  private:
+    std::vector<u8> slotData;   //!< The contents of the slots SlotSection
+    std::vector<u8> headerData; //!< The contents of the slots SlotHeaderSection
+    u64 sourceSteamId{};
+
+    /**
+     * @brief Read a range of bytes from the file
+     */
+    std::vector<u8> readSection(std::ifstream &file, const Section &section, std::string_view path) const;
+
+  public:
+    const size_t index; //!< The index of the slot inside of the source file
+
+    SlotSource(std::filesystem::path path, size_t slotIndex);
+
+    /**
+     * @brief A slot to read from a save file, see ReadAll()
+     */
+    struct Request {
+        std::filesystem::path path;
+        size_t slot;
+    };
+
+    /**
+     * @brief Read the slots of several save files at the same time, every file is read on its own thread so their reads overlap
+     * @param threads The most files read at once, 0 uses ThreadPool::DefaultThreadCount()
+     * @return The slots in the order of the requests
+     * @throw exception If a slot could not be read, the error of the first failed request is thrown once all reads finished
+     */
+    static std::vector<SlotSource> ReadAll(std::span<const Request> requests, size_t threads = 0);
+
+    std::span<u8> slotBytes() {
+        return slotData;
+    }
+
+    std::span<u8> headerBytes() {
+        return headerData;
+    }
+
+    /**
+     * @brief Get the Steam ID from the source's save header
+     */
+    u64 steamId() const {
+        return sourceSteamId;
+    }
 };
 
 /**
  * @brief Elden Ring save file parser and patcher
  */
 class SaveFile {
-  private:
+  public:
     constexpr static size_t SlotCount{10}; //!< The number of slots in each save file starting from 0
-    std::vector<u8> saveDataContainer;
+
+  private:
+    friend class SlotSource;
+    friend class Benchmark;     //!< Measures the private stages of loading and writing, see src/bench
+    friend class SaveGenerator; //!< Fills in the private sections of generated saves, see src/bench
+
+    std::optional<MappedFile> mappedFile;  //!< The mapping backing saveData, if the platform supports it
+    std::vector<u8> saveDataContainer;     //!< The buffer backing saveData if the file could not be mapped
+    util::FileStatus fileStatus{};         //!< The status of the file when it was loaded or last written, see changedOnDisk()
     SaveSpan saveData;
+    std::filesystem::path loadedPath; //!< The path the save data was loaded from
+    DirtyRegions dirty;               //!< The ranges of saveData that were modified since it was loaded or last written
+    size_t checksumThreads{};         //!< The amount of threads used to calculate checksums, 0 uses all available threads
+    bool batching{};                                 //!< If replacements are collected instead of applied, see beginBatch()
+    std::vector<util::Replacement> pendingReplacements; //!< The replacements collected by the current batch
+    std::optional<u64> batchSteamId;                 //!< The Steam ID the save will have once the current batch is applied
 
     constexpr static Section HeaderBNDSection{0x0, 0x3};                 //!< Contains the characters BND, used for validation
     constexpr static Section SaveHeaderSection{0x19003B0, 0x60000};      //!< Contains the save header
     constexpr static Section SaveHeaderChecksumSection{0x19003A0, 0x10}; //!< Contains the MD5 sum of the save header
     constexpr static Section SteamIdSection{0x19003B4, 0x8};             //!< Contains one instance the Steam ID
 
-    std::vector<u8> loadFile(std::filesystem::path path) const;
+    /**
+     * @brief Map the file into memory, or read it into a buffer if mapping is not possible, and validate its contents
+     * @param mode Whether the loaded data will be edited, edits are never written back through the mapping
+     */
+    SaveSpan loadFile(std::filesystem::path path, MappedFile::Mode mode);
+
+    std::vector<u8> readFile(std::filesystem::path path) const;
 
     /**
-     * @brief Replace the Steam ID, recalculate checksums and write the resulting span to a file
+     * @brief Recalculate checksums and write the resulting span to a temporary file that replaces the target once it is complete
+     * @note The checksums are calculated while the rest of the data is being written
      */
-    void write(SaveSpan data, std::filesystem::path path) const;
+    void write(SaveSpan data, std::filesystem::path path);
 
     /**
      * @brief Validate a file is an Elden Ring save file
      * @param target The name of the file to log if validation fails
      */
-    void validateData(SaveSpan data, std::string_view target) const;
+    void validateData(std::span<u8> data, std::string_view target) const;
+
+    /**
+     * @brief Recalculate and replace the checksums of the save header and slots that were modified
+     * @param all Recalculate every checksum, only the checksums are marked as modified
+     * @note The regions are hashed concurrently, see setChecksumThreads()
+     */
+    void recalculateChecksums(SaveSpan data, bool all = false);
+
+    /**
+     * @brief Replace all occurances of a Steam ID inside the target save file
+     * @param oldSteamId The Steam ID to replace
+     */
+    void replaceSteamId(u64 oldSteamId, u64 newSteamId);
+
+    /**
+     * @brief Apply a replacement to the whole save, or add it to the current batch
+     */
+    void replaceEverywhere(util::Replacement replacement);
+
+    /**
+     * @brief Get the Steam ID of the save after any pending replacements
+     */
+    u64 targetSteamId() const {
+        return batchSteamId.value_or(steamId());
+    }
+
+    static std::vector<Slot> CreateSlots();
+
+    /**
+     * @brief A named range of the file, used to describe where a difference between two saves is
+     */
+    struct NamedSection {
+        std::string name;
+        Section section;
+        std::optional<size_t> slot; //!< The slot the range belongs to, if it belongs to one
+    };
 
     /**
-     * @brief Recalculate and replace the save header and slot checksums
+     * @brief Split the file into every range this class knows the meaning of, the ranges in between are named after what contains them
+     * @return Sections that are sorted, do not overlap and cover the whole file
      */
-    void recalculateChecksums(SaveSpan data) const;
+    static std::vector<NamedSection> Layout();
 
     /**
-     * @brief Replace the Steam ID inside the target save file
-     * @param replaceFrom The data containing the Steam ID to replace
+     * @brief Discard what the slots parsed from the replaced ranges
+     * @param matches The offsets the ranges start at, in ascending order
+     * @param size The size of the largest replaced pattern
      */
-    void replaceSteamId(SaveSpan replaceFrom, u64 newSteamId) const;
+    void invalidateSlots(std::span<const size_t> matches, size_t size);
 
-    const std::vector<Slot> parseSlots(SaveSpan data) const;
+    /**
+     * @throw exception If the index is not a valid slot
+     */
+    const Slot &slotAt(size_t slotIndex) const;
+
+    std::vector<Slot> slots; //!< The characters in the save file, these are never recreated and only parse what is requested from them
 
-    void refreshSlots();
+    /**
+     * @brief The checksum of every slot followed by the one of the save header, in the order of ChecksumRanges()
+     */
+    using Checksums = std::array<util::Md5Hash, SlotCount + 1>;
+
+    /**
+     * @brief A checksum and the range it is calculated from
+     */
+    struct ChecksumRange {
+        Section checksum;
+        Section data;
+        std::optional<size_t> slot; //!< The slot the range belongs to, the save header otherwise
+    };
+
+    static std::vector<ChecksumRange> ChecksumRanges();
+
+    /**
+     * @brief Get the checksums currently stored in the save data
+     */
+    Checksums storedChecksums() const;
+
+    /**
+     * @brief Find the ranges whose checksum in the file differs from fileChecksums
+     * @param status The current status of the file
+     * @return Indices into ChecksumRanges()
+     */
+    std::vector<size_t> findChangedRanges(const util::FileStatus &status) const;
+
+    Checksums fileChecksums; //!< The checksums the file had when it was loaded or last written, a mapped file can change below the data so they are kept separately
+
+    constexpr static size_t FastVerifyGroup{2}; //!< The most slots hashed together by verify() when it stops at the first mismatch, so it can stop early
+
+    constexpr static size_t UndoHistoryLimit{64 * 1024 * 1024}; //!< The most bytes of snapshots kept for undo(), the oldest transactions are forgotten first
+
+    /**
+     * @brief Everything needed to undo the modifications of a transaction, see begin()
+     */
+    struct Transaction {
+        PageSnapshot pages;
+        bool batching;
+        std::vector<util::Replacement> pendingReplacements;
+        std::optional<u64> batchSteamId;
+    };
+
+    std::optional<Transaction> transaction; //!< The open transaction, see begin()
+    std::deque<Transaction> undoHistory;    //!< The committed transactions that can be undone, the newest last
+    size_t undoHistorySize{};               //!< The amount of bytes held by the snapshots in undoHistory
+
+    /**
+     * @brief Put back the data a transaction modified and the state of the save when it began
+     */
+    void restore(const Transaction &undone);
 
   public:
-    std::vector<Slot> slots; //!< The characters in the save file
     Items::Items items{};
 
-    SaveFile(std::filesystem::path path) : saveDataContainer{loadFile(path)}, saveData{saveDataContainer}, slots{parseSlots(saveData)} {
-        validateData(saveData, util::ToAbsolutePath(path).generic_string());
+    /**
+     * @brief What reloadChanged() read from the file again
+     */
+    struct Reload {
+        std::vector<size_t> slots; //!< The slots whose data was replaced
+        bool header{};             //!< If the save header was replaced, this contains the headers of all slots and the Steam ID
+
+        bool empty() const {
+            return slots.empty() && !header;
+        }
+
+        std::string describe() const;
+    };
+
+    /**
+     * @brief What verify() found
+     */
+    struct Verification {
+        std::vector<size_t> corruptSlots; //!< The slots whose data does not match their checksum, in ascending order
+        bool corruptHeader{};             //!< If the save header does not match its checksum
+        bool complete{true};              //!< False if verify() stopped at a mismatch before every range was checked
+
+        bool valid() const {
+            return corruptSlots.empty() && !corruptHeader;
+        }
+
+        std::string describe() const;
+    };
+
+    /**
+     * @param mode Use MappedFile::Mode::ReadOnly for save files that are only read from, such as import sources
+     */
+    SaveFile(std::filesystem::path path, MappedFile::Mode mode = MappedFile::Mode::CopyOnWrite) : saveData{loadFile(path, mode)}, loadedPath{path}, slots{CreateSlots()}, fileChecksums{storedChecksums()} {}
+
+    /**
+     * @brief List all items that could not yet be properly parsed, records with the same group, id and quantity are listed together
+     * @param slotIndex The slot to list, or std::nullopt to take a census over all slots at once
+     */
+    void debugListItems(std::optional<size_t> slotIndex, fmt::memory_buffer *output = nullptr) const;
+
+    /**
+     * @brief List every range that differs from another save, with the section it is in and the item records it changes
+     * @param slotIndex Only list the ranges of this slot, or std::nullopt to list the whole file
+     */
+    void printDiff(const SaveFile &other, std::optional<size_t> slotIndex, fmt::memory_buffer *output = nullptr) const;
+
+    /**
+     * @brief Calculate the checksums of the save header and every slot and compare them with the stored ones, without modifying anything
+     * @param stopAtFirstMismatch Skip the ranges that were not hashed yet once a mismatch is found, the slots are hashed in smaller groups for that
+     * @note The ranges are hashed concurrently, see setChecksumThreads()
+     */
+    Verification verify(bool stopAtFirstMismatch = false) const;
+
+    /**
+     * @brief Limit the amount of threads used to calculate checksums
+     * @param threads The amount of threads to use, 1 calculates everything on the calling thread and 0 uses all available threads
+     */
+    void setChecksumThreads(size_t threads) {
+        checksumThreads = threads;
     }
 
-    void debugListItems(int slotIndex);
+    /**
+     * @brief Split the file into the ranges it is backed up in, every slot and its checksum is a separate range
+     * @return Ranges that are sorted, do not overlap and cover the whole file. The slots and the save header refer to their checksums
+     */
+    static std::vector<BackupStore::Range> BackupChunks();
 
     /**
-     * @brief Write the patched save data to a file
+     * @brief Collect the Steam ID and name replacements of the following edits, so applyBatch() can apply them in a single pass over the save
+     * @note The replaced data is not updated until the batch is applied, the slots and steamId() still return the old values
+     */
+    void beginBatch() {
+        batching = true;
+    }
+
+    /**
+     * @brief Apply all replacements collected since beginBatch()
+     * @return The offsets of every replaced match
+     */
+    std::vector<size_t> applyBatch();
+
+    /**
+     * @brief Start recording every modification of the save, so they can be rolled back as a whole
+     * @note Only the 4 KB pages that are modified are copied, the first time something in them is modified
+     * @throw exception If a transaction is already open
+     */
+    void begin();
+
+    /**
+     * @brief Keep the modifications of the open transaction, they can still be undone with undo()
+     */
+    void commit();
+
+    /**
+     * @brief Undo every modification since begin(), this costs the bytes that were modified rather than a copy of the save
+     */
+    void rollback();
+
+    /**
+     * @brief Undo the most recently committed transaction
+     * @return If there was a transaction to undo
+     * @note Transactions are undone newest first. Modifications made outside of a transaction are not undone, unless they overwrote what a transaction modified
+     * @throw exception If a transaction is open
      */
-    void write(std::filesystem::path path) {
-        write(saveData, path);
+    bool undo();
+
+    /**
+     * @brief Run a function in a transaction, it is committed if the function returns and rolled back if it throws
+     */
+    template <typename F> auto transact(F &&function) {
+        begin();
+        try {
+            if constexpr (std::is_void_v<decltype(function())>) {
+                function();
+                commit();
+            } else {
+                auto result{function()};
+                commit();
+                return result;
+            }
+        } catch (...) {
+            rollback();
+            throw;
+        }
     }
 
+    /**
+     * @brief Read the slots and the save header again if their checksums in the file the save was loaded from changed
+     * @note Only the checksums are read to find out what changed, so a file that did not change costs a few reads
+     * @throw exception If a range that changed in the file was also modified in memory, nothing is reloaded in that case
+     * @note Reloading anything forgets the transactions that could be undone, undoing them could overwrite the reloaded data
+     */
+    Reload reloadChanged();
+
+    /**
+     * @brief Check if the file the save was loaded from was changed by something else since it was loaded or last written
+     * @note This is a single stat call if the file was not touched, otherwise only the checksums are read. Ranges without a checksum are not compared
+     */
+    bool changedOnDisk();
+
+    /**
+     * @brief Take the slots and the save header that changed on disk if the file was changed, see reloadChanged()
+     * @throw exception If a range that changed on disk was also modified in memory
+     */
+    Reload mergeChangesOnDisk();
+
+    /**
+     * @brief If anything was modified since the save was loaded or last written
+     */
+    bool modified() const {
+        return !dirty.empty();
+    }
+
+    /**
+     * @brief Write the patched save data to a file
+     * @param inPlace If the path is the file the save was loaded from, only overwrite the modified ranges
+     * @note If nothing was modified every checksum is recalculated, so writing an unmodified save repairs checksums that do not match
+     * @throw exception If the path is the file the save was loaded from and it changed since then, see changedOnDisk(), or if a transaction is open
+     */
+    void write(std::filesystem::path path, bool inPlace = false);
+
     /**
      * @brief Copy a character from a source save file
      * @param source The save file to copy from
@@ -164,6 +579,12 @@ class SaveFile {
 
     void copySlot(size_t sourceSlotIndex, size_t targetSlotIndex);
 
+    /**
+     * @brief Copy a character from a slot that was read from a different save file
+     * @param targetSlotIndex The index of the target save slot to copy to
+     */
+    void copySlot(SlotSource &source, size_t targetSlotIndex);
+
     /**
      * @brief Append a slot from a source save file
      * @param source The save file to copy from
@@ -183,6 +604,16 @@ class SaveFile {
      */
     void setSlotActivity(size_t slotIndex, bool active);
 
+    /**
+     * @brief Check if the given slot is in use
+     */
+    bool isSlotActive(size_t slotIndex) const;
+
+    /**
+     * @brief Get the parsed header of the given slot, the reference stays valid until the slot is modified
+     */
+    const Slot::Metadata &slotMetadata(size_t slotIndex) const;
+
     /**
      * @brief Get the Steam ID from the save header
      */
@@ -191,7 +622,7 @@ class SaveFile {
     /**
      * @brief Replace all occurances of the Steam ID
      */
-    void replaceSteamId(u64 newSteamId) const;
+    void replaceSteamId(u64 newSteamId);
 
     /**
      * @brief Get the quantity of an item in the given slot
@@ -201,11 +632,21 @@ class SaveFile {
     /**
      * @brief Set the quantity of an item in the given slot
      */
-    void setItem(size_t slot, Items::Item item, u32 quantity) const;
+    void setItem(size_t slot, Items::Item item, u32 quantity);
+
+    /**
+     * @brief Set the quantities of many items in the given slot in a single pass
+     */
+    void setItems(size_t slot, std::span<const Items::ItemQuantity> quantities);
+
+    /**
+     * @brief Get every item record in the given slot from its inventory index, see Slot::itemRecords()
+     */
+    std::vector<Items::ItemRecord> itemRecords(size_t slotIndex) const;
 
-    void printActiveSlots() const;
+    void printActiveSlots(fmt::memory_buffer *output = nullptr) const;
 
-    void printSlot(size_t slotIndex) const;
+    void printSlot(size_t slotIndex, fmt::memory_buffer *output = nullptr) const;
 
-    void printItems(size_t slotIndex) const;
+    void printItems(size_t slotIndex, fmt::memory_buffer *output = nullptr) const;
 };
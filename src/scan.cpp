@@ -0,0 +1,319 @@
+#include "util.h"
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#include <immintrin.h>
+#define HAS_X86_SCAN 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAS_NEON_SCAN 1
+#endif
+
+namespace util {
+
+namespace {
+
+/**
+ * @brief A candidate for a pattern starts with first and has last at distance bytes after it
+ */
+struct Filter {
+    u8 first;
+    u8 last;
+    size_t distance;
+};
+
+using Scanner = void (*)(std::span<const u8> data, std::span<const Filter> filters, std::vector<u32> &offsets);
+
+/**
+ * @brief Append the offset of every set bit in a mask of matches starting at base
+ */
+template <typename M> inline void AppendMatches(M mask, size_t base, std::vector<u32> &offsets) {
+    while (mask) {
+        offsets.push_back(static_cast<u32>(base + std::countr_zero(mask)));
+        mask &= mask - 1;
+    }
+}
+
+size_t MaxDistance(std::span<const Filter> filters) {
+    size_t distance{};
+    for (const auto &filter : filters)
+        distance = std::max(distance, filter.distance);
+    return distance;
+}
+
+/**
+ * @brief Scan data starting at index, this is also used for the tail the vector kernels cannot load
+ */
+void ScanScalar(std::span<const u8> data, std::span<const Filter> filters, std::vector<u32> &offsets, size_t index) {
+    for (; index < data.size(); index++)
+        for (const auto &filter : filters)
+            if (index + filter.distance < data.size() && data[index] == filter.first && data[index + filter.distance] == filter.last) {
+                offsets.push_back(static_cast<u32>(index));
+                break;
+            }
+}
+
+[[maybe_unused]] void ScanScalar(std::span<const u8> data, std::span<const Filter> filters, std::vector<u32> &offsets) {
+    ScanScalar(data, filters, offsets, 0);
+}
+
+#ifdef HAS_X86_SCAN
+
+__attribute__((target("sse2"))) void ScanSse2(std::span<const u8> data, std::span<const Filter> filters, std::vector<u32> &offsets) {
+    constexpr size_t Width{16};
+    const auto maxDistance{MaxDistance(filters)};
+
+    size_t index{};
+    // Every block also reads the bytes after it, so the last ones have to stop early
+    for (; index + Width + maxDistance <= data.size(); index += Width) {
+        const auto current{_mm_loadu_si128(reinterpret_cast<const __m128i *>(data.data() + index))};
+        u32 mask{};
+        for (const auto &filter : filters) {
+            const auto last{_mm_loadu_si128(reinterpret_cast<const __m128i *>(data.data() + index + filter.distance))};
+            const auto matches{_mm_and_si128(_mm_cmpeq_epi8(current, _mm_set1_epi8(static_cast<char>(filter.first))), _mm_cmpeq_epi8(last, _mm_set1_epi8(static_cast<char>(filter.last))))};
+            mask |= static_cast<u32>(_mm_movemask_epi8(matches));
+        }
+        AppendMatches(mask, index, offsets);
+    }
+    ScanScalar(data, filters, offsets, index);
+}
+
+__attribute__((target("avx2"))) void ScanAvx2(std::span<const u8> data, std::span<const Filter> filters, std::vector<u32> &offsets) {
+    constexpr size_t Width{32};
+    const auto maxDistance{MaxDistance(filters)};
+
+    size_t index{};
+    for (; index + Width + maxDistance <= data.size(); index += Width) {
+        const auto current{_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data.data() + index))};
+        u32 mask{};
+        for (const auto &filter : filters) {
+            const auto last{_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data.data() + index + filter.distance))};
+            const auto matches{_mm256_and_si256(_mm256_cmpeq_epi8(current, _mm256_set1_epi8(static_cast<char>(filter.first))), _mm256_cmpeq_epi8(last, _mm256_set1_epi8(static_cast<char>(filter.last))))};
+            mask |= static_cast<u32>(_mm256_movemask_epi8(matches));
+        }
+        AppendMatches(mask, index, offsets);
+    }
+    ScanScalar(data, filters, offsets, index);
+}
+
+#endif
+
+#ifdef HAS_NEON_SCAN
+
+void ScanNeon(std::span<const u8> data, std::span<const Filter> filters, std::vector<u32> &offsets) {
+    constexpr size_t Width{16};
+    const auto maxDistance{MaxDistance(filters)};
+
+    size_t index{};
+    for (; index + Width + maxDistance <= data.size(); index += Width) {
+        const auto current{vld1q_u8(data.data() + index)};
+        auto matches{vdupq_n_u8(0)};
+        for (const auto &filter : filters)
+            matches = vorrq_u8(matches, vandq_u8(vceqq_u8(current, vdupq_n_u8(filter.first)), vceqq_u8(vld1q_u8(data.data() + index + filter.distance), vdupq_n_u8(filter.last))));
+        // NEON has no movemask, narrowing every byte to a nibble gives a 64-bit mask with 4 bits per byte instead
+        const auto nibbles{vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(matches), 4)), 0)};
+        for (auto mask{nibbles & 0x8888888888888888ULL}; mask; mask &= mask - 1)
+            offsets.push_back(static_cast<u32>(index + std::countr_zero(mask) / 4));
+    }
+    ScanScalar(data, filters, offsets, index);
+}
+
+#endif
+
+Scanner SelectScanner() {
+#ifdef HAS_X86_SCAN
+    if (__builtin_cpu_supports("avx2"))
+        return ScanAvx2;
+    return ScanSse2;
+#elif defined(HAS_NEON_SCAN)
+    return ScanNeon;
+#else
+    return ScanScalar;
+#endif
+}
+
+constexpr size_t DiffBlockSize{4096}; //!< Blocks of this size are compared as a whole first, so identical ones are skipped without looking at their bytes
+
+using Differ = void (*)(std::span<const u8> first, std::span<const u8> second, std::vector<Section> &ranges);
+
+/**
+ * @brief Append a range of differing bytes, merging it into the previous range if they are adjacent
+ */
+inline void AppendDifference(size_t address, size_t size, std::vector<Section> &ranges) {
+    if (!ranges.empty() && ranges.back().length == address)
+        ranges.back() = Section{ranges.back().address, ranges.back().size + size};
+    else
+        ranges.emplace_back(address, size);
+}
+
+/**
+ * @brief Append the runs of set bits in a mask of differing bytes starting at base
+ */
+inline void AppendDifferences(u32 mask, size_t base, std::vector<Section> &ranges) {
+    while (mask) {
+        const auto start{std::countr_zero(mask)};
+        const auto run{std::countr_one(mask >> start)};
+        AppendDifference(base + start, run, ranges);
+        mask = run + start >= 32 ? 0 : mask & (~0U << (start + run));
+    }
+}
+
+void DiffScalar(std::span<const u8> first, std::span<const u8> second, std::vector<Section> &ranges, size_t index, size_t end) {
+    for (; index < end; index++)
+        if (first[index] != second[index])
+            AppendDifference(index, 1, ranges);
+}
+
+[[maybe_unused]] void DiffScalar(std::span<const u8> first, std::span<const u8> second, std::vector<Section> &ranges) {
+    for (size_t index{}; index < first.size(); index += DiffBlockSize) {
+        const auto size{std::min(DiffBlockSize, first.size() - index)};
+        if (!std::equal(first.begin() + index, first.begin() + index + size, second.begin() + index))
+            DiffScalar(first, second, ranges, index, index + size);
+    }
+}
+
+#ifdef HAS_X86_SCAN
+
+__attribute__((target("sse2"))) void DiffSse2(std::span<const u8> first, std::span<const u8> second, std::vector<Section> &ranges) {
+    constexpr size_t Width{16};
+    const auto firstData{reinterpret_cast<const __m128i *>(first.data())};
+    const auto secondData{reinterpret_cast<const __m128i *>(second.data())};
+
+    size_t index{};
+    for (; index + DiffBlockSize <= first.size(); index += DiffBlockSize) {
+        auto differences{_mm_setzero_si128()};
+        for (auto vector{index / Width}; vector < (index + DiffBlockSize) / Width; vector++)
+            differences = _mm_or_si128(differences, _mm_xor_si128(_mm_loadu_si128(firstData + vector), _mm_loadu_si128(secondData + vector)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(differences, _mm_setzero_si128())) == 0xFFFF)
+            continue;
+
+        for (auto vector{index / Width}; vector < (index + DiffBlockSize) / Width; vector++)
+            AppendDifferences(~static_cast<u32>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(firstData + vector), _mm_loadu_si128(secondData + vector)))) & 0xFFFF, vector * Width, ranges);
+    }
+    DiffScalar(first, second, ranges, index, first.size());
+}
+
+__attribute__((target("avx2"))) void DiffAvx2(std::span<const u8> first, std::span<const u8> second, std::vector<Section> &ranges) {
+    constexpr size_t Width{32};
+    const auto firstData{reinterpret_cast<const __m256i *>(first.data())};
+    const auto secondData{reinterpret_cast<const __m256i *>(second.data())};
+
+    size_t index{};
+    for (; index + DiffBlockSize <= first.size(); index += DiffBlockSize) {
+        auto differences{_mm256_setzero_si256()};
+        for (auto vector{index / Width}; vector < (index + DiffBlockSize) / Width; vector++)
+            differences = _mm256_or_si256(differences, _mm256_xor_si256(_mm256_loadu_si256(firstData + vector), _mm256_loadu_si256(secondData + vector)));
+        if (_mm256_testz_si256(differences, differences))
+            continue;
+
+        for (auto vector{index / Width}; vector < (index + DiffBlockSize) / Width; vector++)
+            AppendDifferences(~static_cast<u32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(firstData + vector), _mm256_loadu_si256(secondData + vector)))), vector * Width, ranges);
+    }
+    DiffScalar(first, second, ranges, index, first.size());
+}
+
+#endif
+
+#ifdef HAS_NEON_SCAN
+
+void DiffNeon(std::span<const u8> first, std::span<const u8> second, std::vector<Section> &ranges) {
+    constexpr size_t Width{16};
+
+    size_t index{};
+    for (; index + DiffBlockSize <= first.size(); index += DiffBlockSize) {
+        auto differences{vdupq_n_u8(0)};
+        for (size_t offset{}; offset < DiffBlockSize; offset += Width)
+            differences = vorrq_u8(differences, veorq_u8(vld1q_u8(first.data() + index + offset), vld1q_u8(second.data() + index + offset)));
+        // Changed blocks are rare, so only finding them is vectorized
+        if (vmaxvq_u8(differences))
+            DiffScalar(first, second, ranges, index, index + DiffBlockSize);
+    }
+    DiffScalar(first, second, ranges, index, first.size());
+}
+
+#endif
+
+Differ SelectDiffer() {
+#ifdef HAS_X86_SCAN
+    if (__builtin_cpu_supports("avx2"))
+        return DiffAvx2;
+    return DiffSse2;
+#elif defined(HAS_NEON_SCAN)
+    return DiffNeon;
+#else
+    return DiffScalar;
+#endif
+}
+
+/**
+ * @brief Find the offsets at which any of the filters match, in ascending order
+ */
+std::vector<u32> FindCandidates(std::span<const u8> data, std::span<const Filter> filters) {
+    static const Scanner scanner{SelectScanner()};
+    if (data.size() > std::numeric_limits<u32>::max())
+        throw exception("Cannot scan {} bytes, offsets are limited to 32 bits", data.size());
+
+    std::vector<u32> offsets{};
+    scanner(data, filters, offsets);
+    return offsets;
+}
+
+} // namespace
+
+std::vector<Section> FindDifferences(std::span<const u8> first, std::span<const u8> second) {
+    static const Differ differ{SelectDiffer()};
+    if (first.size() != second.size())
+        throw exception("Cannot compare {} bytes with {} bytes", first.size(), second.size());
+
+    std::vector<Section> ranges;
+    differ(first, second, ranges);
+    return ranges;
+}
+
+std::vector<u32> FindPairs(std::span<const u8> data, std::array<u8, 2> pair) {
+    const Filter filter{pair.front(), pair.back(), 1};
+    return FindCandidates(data, std::span{&filter, 1});
+}
+
+std::vector<size_t> ReplaceAll(std::span<u8> data, std::span<const Replacement> replacements, DirtyRegions *dirty) {
+    std::vector<Filter> filters;
+    for (const auto &replacement : replacements) {
+        if (replacement.find.size() != replacement.replace.size())
+            throw exception("Size of find does not match replace");
+        if (replacement.find.empty())
+            throw exception("Cannot replace an empty pattern");
+        filters.push_back({replacement.find.front(), replacement.find.back(), replacement.find.size() - 1});
+    }
+
+    std::vector<size_t> matches;
+    size_t checkedUntil{}; // Every offset before this was already checked against the rewritten data
+
+    const auto replaceAt{[&](size_t offset) {
+        for (const auto &replacement : replacements) {
+            if (offset + replacement.find.size() > data.size() || !std::equal(replacement.find.begin(), replacement.find.end(), data.begin() + offset))
+                continue;
+
+            if (dirty)
+                dirty->mark(offset, replacement.replace.size());
+            std::copy(replacement.replace.begin(), replacement.replace.end(), data.begin() + offset);
+            matches.push_back(offset);
+            checkedUntil = std::max(checkedUntil, offset + replacement.replace.size());
+            return true;
+        }
+        return false;
+    }};
+
+    for (const size_t candidate : FindCandidates(data, filters)) {
+        if (candidate < checkedUntil || !replaceAt(candidate))
+            continue;
+
+        // The candidates were found in the original data, a replacement can create new matches overlapping with it
+        for (auto offset{candidate + 1}; offset < checkedUntil; offset++)
+            replaceAt(offset);
+    }
+    return matches;
+}
+
+} // namespace util
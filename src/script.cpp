@@ -0,0 +1,176 @@
+#include "script.h"
+#include <array>
+#include <chrono>
+#include <fmt/format.h>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+struct CommandInfo {
+    std::string_view name;
+    Script::Command command;
+    size_t argumentCount;
+};
+
+// clang-format off
+constexpr std::array<CommandInfo, 7> Commands{{
+    {"set-item", Script::Command::SetItem, 3},
+    {"rename", Script::Command::Rename, 2},
+    {"copy", Script::Command::Copy, 2},
+    {"import", Script::Command::Import, 3},
+    {"steam-id", Script::Command::SteamId, 1},
+    {"set-active", Script::Command::SetActive, 2},
+    {"undo", Script::Command::Undo, 0},
+}};
+// clang-format on
+
+} // namespace
+
+Script::Script(std::istream &input, std::string source) : source{std::move(source)} {
+    std::string line;
+    for (size_t lineNumber{1}; std::getline(input, line); lineNumber++) {
+        auto words{tokenize(line, lineNumber)};
+        if (words.empty() || words.front().starts_with('#'))
+            continue;
+
+        const auto info{std::find_if(Commands.begin(), Commands.end(), [&words](const CommandInfo &info) {
+            return info.name == words.front();
+        })};
+        if (info == Commands.end())
+            throw exception("{}:{}: Unknown operation '{}'", this->source, lineNumber, words.front());
+        if (words.size() - 1 != info->argumentCount)
+            throw exception("{}:{}: '{}' expects {} arguments but got {}", this->source, lineNumber, info->name, info->argumentCount, words.size() - 1);
+
+        words.erase(words.begin());
+        try {
+            operations.push_back(Parse(info->command, lineNumber, words));
+        } catch (const std::exception &error) {
+            throw exception("{}:{}: {}", this->source, lineNumber, error.what());
+        }
+    }
+    if (input.bad())
+        throw exception("Failed to read script '{}'", this->source);
+}
+
+Script Script::FromPath(std::string_view path) {
+    if (path == "-")
+        return Script{std::cin, "<stdin>"};
+
+    std::ifstream file{std::filesystem::path{path}};
+    if (!file.is_open())
+        throw exception("Could not open script '{}'", util::ToAbsolutePath(path).generic_string());
+    return Script{file, std::string{path}};
+}
+
+std::vector<std::string> Script::tokenize(std::string_view line, size_t lineNumber) const {
+    std::vector<std::string> words;
+    size_t index{};
+    while (true) {
+        index = line.find_first_not_of(util::Whitespace, index);
+        if (index == std::string_view::npos)
+            break;
+
+        if (line[index] == '"') {
+            const auto end{line.find('"', index + 1)};
+            if (end == std::string_view::npos)
+                throw exception("{}:{}: Unterminated quote", source, lineNumber);
+            words.emplace_back(line.substr(index + 1, end - index - 1));
+            index = end + 1;
+        } else {
+            const auto end{std::min(line.find_first_of(util::Whitespace, index), line.size())};
+            words.emplace_back(line.substr(index, end - index));
+            index = end;
+        }
+    }
+    return words;
+}
+
+Script::Operation Script::Parse(Command command, size_t line, std::vector<std::string> &arguments) {
+    Operation operation{command, line};
+    switch (command) {
+    case Command::SetItem:
+        operation.slots[0] = util::ToSlot(arguments[0], SaveFile::SlotCount);
+        operation.item = Items::Items{}[arguments[1]];
+        operation.text = std::move(arguments[1]);
+        operation.value = util::ToNumber<u32>(arguments[2]);
+        break;
+    case Command::Rename:
+        operation.slots[0] = util::ToSlot(arguments[0], SaveFile::SlotCount);
+        operation.text = std::move(arguments[1]);
+        break;
+    case Command::Copy:
+        operation.slots = {util::ToSlot(arguments[0], SaveFile::SlotCount), util::ToSlot(arguments[1], SaveFile::SlotCount)};
+        break;
+    case Command::Import:
+        operation.text = std::move(arguments[0]);
+        operation.slots = {util::ToSlot(arguments[1], SaveFile::SlotCount), util::ToSlot(arguments[2], SaveFile::SlotCount)};
+        break;
+    case Command::SteamId:
+        operation.value = util::ToNumber<u64>(arguments[0]);
+        break;
+    case Command::SetActive:
+        operation.slots[0] = util::ToSlot(arguments[0], SaveFile::SlotCount);
+        if (arguments[1] == "true" || arguments[1] == "1")
+            operation.active = true;
+        else if (arguments[1] == "false" || arguments[1] == "0")
+            operation.active = false;
+        else
+            throw exception("Expected true or false but got '{}'", arguments[1]);
+        break;
+    case Command::Undo:
+        break;
+    }
+    return operation;
+}
+
+std::string Script::apply(SaveFile &saveFile, const Operation &operation) const {
+    const auto &slots{operation.slots};
+    switch (operation.command) {
+    case Command::SetItem:
+        saveFile.setItem(slots[0], operation.item, static_cast<u32>(operation.value));
+        return fmt::format("set item '{}' to {} in slot {}", operation.text, operation.value, slots[0]);
+    case Command::Rename:
+        saveFile.renameSlot(slots[0], operation.text);
+        return fmt::format("renamed slot {} to '{}'", slots[0], operation.text);
+    case Command::Copy:
+        saveFile.copySlot(slots[0], slots[1]);
+        return fmt::format("copied slot {} to slot {}", slots[0], slots[1]);
+    case Command::Import: {
+        SlotSource importSlot{operation.text, slots[0]};
+        saveFile.copySlot(importSlot, slots[1]);
+        return fmt::format("imported slot {} from savefile '{}' into slot {}", slots[0], operation.text, slots[1]);
+    }
+    case Command::SteamId:
+        saveFile.replaceSteamId(operation.value);
+        return fmt::format("Steam ID set to {}", operation.value);
+    case Command::SetActive:
+        saveFile.setSlotActivity(slots[0], operation.active);
+        return fmt::format("set slot {} {}", slots[0], operation.active ? "active" : "inactive");
+    case Command::Undo:
+        if (!saveFile.undo())
+            throw exception("There is nothing to undo");
+        return "undid the previous operation";
+    }
+    throw exception("Unhandled operation");
+}
+
+void Script::run(SaveFile &saveFile, fmt::memory_buffer *output) const {
+    for (const auto &operation : operations) {
+        const auto start{std::chrono::steady_clock::now()};
+        std::string description;
+        try {
+            // Undoing is not an operation of its own, otherwise the next undo would redo what it undid
+            if (operation.command == Command::Undo)
+                description = apply(saveFile, operation);
+            else
+                description = saveFile.transact([&]() {
+                    return apply(saveFile, operation);
+                });
+        } catch (const std::exception &error) {
+            throw exception("{}:{}: {}", source, operation.line, error.what());
+        }
+        const std::chrono::duration<double, std::milli> duration{std::chrono::steady_clock::now() - start};
+        util::Print(output, "{}:{}: {} ({:.2f} ms)\n", source, operation.line, description, duration.count());
+    }
+}
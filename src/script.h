@@ -0,0 +1,97 @@
+#include "savefile/savefile.h"
+#include "util.h"
+#include <array>
+#include <filesystem>
+#include <istream>
+#include <string>
+#include <vector>
+
+#pragma once
+
+/**
+ * @brief A sequence of operations that are applied to a single loaded save file
+ * @note Every line contains one operation followed by its arguments separated by spaces, arguments containing spaces can be quoted. Lines starting with '#' are ignored
+ *
+ * set-item <slot> <item name> <amount>
+ * rename <slot> <new name>
+ * copy <source slot> <target slot>
+ * import <savefile> <source slot> <target slot>
+ * steam-id <Steam ID>
+ * set-active <slot> <true|false>
+ * undo
+ *
+ * 'undo' takes back the most recent operation that was not undone yet, see SaveFile::undo()
+ */
+class Script {
+  public:
+    enum class Command {
+        SetItem,
+        Rename,
+        Copy,
+        Import,
+        SteamId,
+        SetActive,
+        Undo,
+    };
+
+    /**
+     * @brief An operation with its arguments converted while parsing, which of them are used depends on the command
+     */
+    struct Operation {
+        Command command;
+        size_t line;                   //!< The line in the script the operation was read from
+        std::array<size_t, 2> slots{}; //!< The slots in the order they are given, the first slot of 'import' is the one in the other savefile
+        Items::Item item{};            //!< The item of 'set-item'
+        u64 value{};                   //!< The amount of 'set-item' or the Steam ID of 'steam-id'
+        bool active{};                 //!< The state of 'set-active'
+        std::string text;              //!< The item name of 'set-item', the new name of 'rename' or the savefile of 'import'
+    };
+
+  private:
+    std::string source; //!< The name of the script used in error messages
+    std::vector<Operation> operations;
+
+    /**
+     * @brief Split a line into words, respecting double quotes
+     */
+    std::vector<std::string> tokenize(std::string_view line, size_t lineNumber) const;
+
+    /**
+     * @brief Convert the arguments of an operation
+     * @param arguments The words following the name of the operation, their amount was already validated
+     * @throw exception If an argument is not a valid slot, number, item or state, the constructor adds the line of the operation to it
+     */
+    static Operation Parse(Command command, size_t line, std::vector<std::string> &arguments);
+
+    /**
+     * @brief Apply a single operation
+     * @return A description of what was done
+     */
+    std::string apply(SaveFile &saveFile, const Operation &operation) const;
+
+  public:
+    /**
+     * @brief Read and validate all operations, nothing is applied until run() is called
+     * @param source The name of the script used in error messages
+     * @throw exception If the script contains an unknown operation, an operation has the wrong amount of arguments or one of them is invalid
+     * @note Slots, numbers and items are all converted here, so a typo in a later line does not leave the earlier ones applied
+     */
+    Script(std::istream &input, std::string source);
+
+    /**
+     * @brief Read a script from a file, or from stdin if the path is '-'
+     */
+    static Script FromPath(std::string_view path);
+
+    /**
+     * @brief Apply all operations in order and print how long each of them took
+     * @param output The buffer to print to instead of stdout, see util::Print()
+     * @note Every operation is a transaction of the save file, so it can be undone by a later 'undo', also by one of a later run
+     * @throw exception If an operation fails, it is rolled back but the operations before it stay applied to the save file in memory
+     */
+    void run(SaveFile &saveFile, fmt::memory_buffer *output = nullptr) const;
+
+    size_t size() const {
+        return operations.size();
+    }
+};
@@ -0,0 +1,296 @@
+#include "server.h"
+#include "backup.h"
+#include "script.h"
+#include <algorithm>
+#include <array>
+#include <sstream>
+
+#ifdef HAS_SERVER
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int PollInterval{200}; //!< How often the blocking loops check if the server is stopping, in milliseconds
+
+/**
+ * @brief Send all of the data, a client that went away is noticed by the next read of its connection
+ */
+void Send(int fd, std::string_view data) {
+    while (!data.empty()) {
+        const auto sent{send(fd, data.data(), data.size(), MSG_NOSIGNAL)};
+        if (sent == -1 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return;
+        data.remove_prefix(static_cast<size_t>(sent));
+    }
+}
+
+} // namespace
+
+Server::LoadedSave::LoadedSave(std::filesystem::path path, size_t checksumThreads) : path{std::move(path)}, save{this->path} {
+    save.setChecksumThreads(checksumThreads);
+}
+
+Server::Server(std::filesystem::path socketPath, size_t checksumThreads) : socketPath{std::move(socketPath)}, checksumThreads{checksumThreads} {}
+
+Server::~Server() {
+    reap(true);
+    if (listener != -1) {
+        close(listener);
+        std::error_code error;
+        std::filesystem::remove(socketPath, error);
+    }
+    if (watcher != -1)
+        close(watcher);
+}
+
+void Server::run() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    const auto &native{socketPath.native()};
+    if (native.size() >= sizeof(address.sun_path))
+        throw exception("The socket path '{}' is too long", socketPath.generic_string());
+    std::copy(native.begin(), native.end(), address.sun_path);
+
+    watcher = inotify_init1(IN_CLOEXEC);
+    if (watcher == -1)
+        throw exception("Could not watch for changes of savefiles: {}", std::strerror(errno));
+
+    // A socket left behind by a server that did not shut down would make binding fail
+    if (std::filesystem::is_socket(socketPath))
+        std::filesystem::remove(socketPath);
+    const auto fd{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+    if (fd == -1)
+        throw exception("Could not create a socket: {}", std::strerror(errno));
+    if (bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1) {
+        const auto error{errno};
+        close(fd);
+        throw exception("Could not listen on '{}': {}", socketPath.generic_string(), std::strerror(error));
+    }
+    listener = fd; // The socket file is removed once it is bound
+    if (listen(listener, SOMAXCONN) == -1)
+        throw exception("Could not listen on '{}': {}", socketPath.generic_string(), std::strerror(errno));
+
+    fmt::print("listening on '{}'\n", socketPath.generic_string());
+    std::fflush(stdout);
+    std::thread watchThread{[this]() {
+        watch();
+    }};
+
+    while (!stopping) {
+        pollfd descriptor{listener, POLLIN, 0};
+        const auto ready{poll(&descriptor, 1, PollInterval)};
+        reap(false);
+        if (ready <= 0)
+            continue;
+
+        const auto client{accept4(listener, nullptr, nullptr, SOCK_CLOEXEC)};
+        if (client == -1)
+            continue;
+        const std::scoped_lock lock{connectionsMutex};
+        auto &connection{connections.emplace_back()};
+        connection.fd = client;
+        connection.thread = std::thread{[this, &connection]() {
+            serve(connection);
+        }};
+    }
+
+    reap(true);
+    watchThread.join();
+    fmt::print("stopped listening on '{}'\n", socketPath.generic_string());
+}
+
+void Server::reap(bool all) {
+    std::list<Connection> finished;
+    {
+        const std::scoped_lock lock{connectionsMutex};
+        for (auto connection{connections.begin()}; connection != connections.end();) {
+            const auto next{std::next(connection)};
+            if (all)
+                shutdown(connection->fd, SHUT_RDWR); // Wakes up the thread if it is waiting for a request
+            if (all || connection->finished)
+                finished.splice(finished.end(), connections, connection);
+            connection = next;
+        }
+    }
+
+    for (auto &connection : finished) {
+        connection.thread.join();
+        close(connection.fd);
+    }
+}
+
+std::shared_ptr<Server::LoadedSave> Server::open(const std::filesystem::path &path) {
+    const auto canonical{std::filesystem::weakly_canonical(util::ToAbsolutePath(path))};
+    const std::scoped_lock lock{savesMutex};
+    if (const auto loaded{saves.find(canonical)}; loaded != saves.end())
+        return loaded->second;
+
+    auto loaded{std::make_shared<LoadedSave>(canonical, checksumThreads)};
+    // The directory is watched rather than the file, saves are replaced by renaming a new file over them
+    const auto directory{canonical.parent_path()};
+    const auto descriptor{inotify_add_watch(watcher, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO)};
+    if (descriptor == -1)
+        throw exception("Could not watch '{}' for changes: {}", directory.generic_string(), std::strerror(errno));
+    watches[descriptor] = directory;
+    saves[canonical] = loaded;
+    fmt::print("loaded '{}'\n", canonical.generic_string());
+    std::fflush(stdout);
+    return loaded;
+}
+
+void Server::watch() {
+    alignas(inotify_event) std::array<char, 4096> buffer;
+    while (!stopping) {
+        pollfd descriptor{watcher, POLLIN, 0};
+        if (poll(&descriptor, 1, PollInterval) <= 0)
+            continue;
+        const auto length{read(watcher, buffer.data(), buffer.size())};
+        if (length <= 0)
+            continue;
+
+        // The events are collected first, so no save is locked while the table of saves is
+        std::vector<std::shared_ptr<LoadedSave>> changed;
+        {
+            const std::scoped_lock lock{savesMutex};
+            for (auto offset{0l}; offset < length;) {
+                const auto event{reinterpret_cast<const inotify_event *>(buffer.data() + offset)};
+                offset += static_cast<long>(sizeof(inotify_event) + event->len);
+
+                const auto directory{watches.find(event->wd)};
+                if (!event->len || directory == watches.end())
+                    continue;
+                const auto loaded{saves.find(directory->second / event->name)};
+                if (loaded != saves.end() && std::find(changed.begin(), changed.end(), loaded->second) == changed.end())
+                    changed.push_back(loaded->second);
+            }
+        }
+
+        for (const auto &loaded : changed)
+            reload(*loaded);
+    }
+}
+
+void Server::reload(LoadedSave &loaded) {
+    try {
+        const std::scoped_lock lock{loaded.mutex};
+        const auto reloaded{loaded.save.reloadChanged()};
+        if (!reloaded.empty())
+            fmt::print("'{}' changed on disk, {}\n", loaded.path.generic_string(), reloaded.describe());
+    } catch (const std::exception &error) {
+        // The save keeps the data it had, the next change of the file or a 'reload' request tries again
+        fmt::print(stderr, "could not reload '{}': {}\n", loaded.path.generic_string(), error.what());
+    }
+    std::fflush(stdout);
+}
+
+void Server::serve(Connection &connection) {
+    std::shared_ptr<LoadedSave> current;
+    std::string pending;
+    std::array<char, 4096> buffer;
+    bool open{true};
+
+    while (open && !stopping) {
+        const auto received{recv(connection.fd, buffer.data(), buffer.size(), 0)};
+        if (received == -1 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            break;
+        pending.append(buffer.data(), static_cast<size_t>(received));
+
+        size_t lineEnd{};
+        while (open && (lineEnd = pending.find('\n')) != std::string::npos) {
+            fmt::memory_buffer output;
+            try {
+                open = handle(util::Trim(std::string_view{pending}.substr(0, lineEnd)), current, output);
+                util::Print(&output, "ok\n");
+            } catch (const std::exception &error) {
+                std::string message{error.what()};
+                std::replace(message.begin(), message.end(), '\n', ' '); // The status always takes a single line
+                util::Print(&output, "error {}\n", message);
+            }
+            Send(connection.fd, {output.data(), output.size()});
+            pending.erase(0, lineEnd + 1);
+        }
+
+        if (pending.size() > MaxRequestSize) {
+            Send(connection.fd, fmt::format("error Requests cannot be longer than {} bytes\n", MaxRequestSize));
+            break;
+        }
+    }
+    connection.finished = true;
+}
+
+bool Server::handle(std::string_view request, std::shared_ptr<LoadedSave> &current, fmt::memory_buffer &output) {
+    const auto separator{request.find_first_of(util::Whitespace)};
+    const auto command{request.substr(0, separator)};
+    auto argument{separator == std::string_view::npos ? std::string_view{} : util::Trim(request.substr(separator))};
+
+    if (command.empty() || command.starts_with('#'))
+        return true;
+    if (command == "quit")
+        return false;
+    if (command == "shutdown") {
+        stopping = true;
+        util::Print(&output, "shutting down\n");
+        return false;
+    }
+    if (command == "open") {
+        if (argument.size() >= 2 && argument.front() == '"' && argument.back() == '"')
+            argument = argument.substr(1, argument.size() - 2);
+        if (argument.empty())
+            throw exception("'open' expects a savefile");
+        current = open(argument);
+        const std::scoped_lock lock{current->mutex};
+        util::Print(&output, "using savefile '{}'\nSteam ID embedded in the savefile: {}\n", current->path.string(), current->save.steamId());
+        return true;
+    }
+
+    if (!current)
+        throw exception("No savefile is open, use 'open <savefile>' first");
+    const std::scoped_lock lock{current->mutex};
+    auto &saveFile{current->save};
+
+    if (command == "show")
+        saveFile.printActiveSlots(&output);
+    else if (command == "slot")
+        saveFile.printSlot(util::ToSlot(argument, SaveFile::SlotCount), &output);
+    else if (command == "list-items") {
+        const auto slot{util::ToSlot(argument, SaveFile::SlotCount)};
+        saveFile.printSlot(slot, &output);
+        saveFile.printItems(slot, &output);
+    } else if (command == "reload")
+        util::Print(&output, "{}\n", saveFile.reloadChanged().describe());
+    else if (command == "write") {
+        if (!argument.empty() && argument != "in-place")
+            throw exception("Expected 'write' or 'write in-place' but got '{}'", request);
+        const auto backup{BackupStore::Default().backup(current->path, SaveFile::BackupChunks())};
+        util::Print(&output, "wrote a backup of the original savefile as '{}'\n", backup);
+        saveFile.write(current->path, argument == "in-place");
+        util::Print(&output, "succesfully wrote changes to '{}'\n", current->path.generic_string());
+    } else {
+        std::istringstream input{std::string{request}};
+        const Script script{input, "request"};
+        script.run(saveFile, &output);
+    }
+    return true;
+}
+
+#else
+
+Server::Server(std::filesystem::path socketPath, size_t checksumThreads) : socketPath{std::move(socketPath)}, checksumThreads{checksumThreads} {}
+
+Server::~Server() = default;
+
+void Server::run() {
+    throw exception("'--serve' is not supported on this platform");
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include "savefile/savefile.h"
+#include "util.h"
+#include <atomic>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+#pragma once
+
+#if __has_include(<sys/inotify.h>) && __has_include(<sys/un.h>)
+#define HAS_SERVER 1
+#endif
+
+/**
+ * @brief Keeps save files loaded and applies requests sent to a Unix socket, so repeated edits do not pay for starting up and loading the save
+ * @note Every request is a single line. Its response is the output of the request followed by a line that is either 'ok' or 'error <message>'.
+ * Requests for the same save are applied one at a time, requests for different saves run concurrently
+ *
+ * open <savefile>       Load a save, or share the one another connection loaded. The following requests of the connection apply to it
+ * show                  Print all active slots
+ * slot <slot>           Print a single slot
+ * list-items <slot>     Print the items in a slot
+ * reload                Read the slots that changed on disk again, this also happens when the file is replaced
+ * write [in-place]      Back up the file and write the changes to it
+ * quit                  Close the connection
+ * shutdown              Stop the server once all requests in progress are done
+ *
+ * Any other request is an operation of Script, such as 'set-item 0 golden-seed 10'. A request that fails is rolled back, 'undo' takes back the
+ * previous one
+ */
+class Server {
+  public:
+#ifdef HAS_SERVER
+    constexpr static bool Supported{true};
+#else
+    constexpr static bool Supported{false}; //!< If false, run() will always throw
+#endif
+
+  private:
+    constexpr static size_t MaxRequestSize{64 * 1024}; //!< Connections sending longer lines are closed
+
+    struct LoadedSave {
+        std::filesystem::path path; //!< The canonical path of the file
+        std::mutex mutex;           //!< Held while a request or a reload uses the save
+        SaveFile save;
+
+        LoadedSave(std::filesystem::path path, size_t checksumThreads);
+    };
+
+    struct Connection {
+        int fd;
+        std::thread thread;
+        std::atomic<bool> finished{}; //!< Set by the thread once it no longer uses the connection, so it can be joined
+    };
+
+    std::filesystem::path socketPath;
+    size_t checksumThreads;
+    int listener{-1};
+    int watcher{-1}; //!< The inotify instance watching the directories of all loaded saves
+    std::atomic<bool> stopping{};
+
+    std::mutex savesMutex;                                              //!< Guards saves and watches
+    std::map<std::filesystem::path, std::shared_ptr<LoadedSave>> saves; //!< Keyed by canonical path, saves stay loaded until the server stops
+    std::map<int, std::filesystem::path> watches;                       //!< The watched directories, keyed by their watch descriptor
+
+    std::mutex connectionsMutex; //!< Guards connections
+    std::list<Connection> connections;
+
+    /**
+     * @brief Get the loaded save for a path, loading and watching it if no connection did so yet
+     */
+    std::shared_ptr<LoadedSave> open(const std::filesystem::path &path);
+
+    /**
+     * @brief Reload the saves whose files were replaced or written to until the server stops
+     */
+    void watch();
+
+    /**
+     * @brief Read the parts of a save that changed on disk again, a save with unsaved changes in the same parts is left as it is
+     */
+    void reload(LoadedSave &loaded);
+
+    /**
+     * @brief Answer the requests of a connection until it is closed
+     */
+    void serve(Connection &connection);
+
+    /**
+     * @brief Apply a single request
+     * @param current The save the connection uses, changed by 'open'
+     * @return If the connection should stay open
+     * @throw exception If the request failed, the error is sent as the response
+     */
+    bool handle(std::string_view request, std::shared_ptr<LoadedSave> &current, fmt::memory_buffer &output);
+
+    /**
+     * @brief Join the threads of connections that were closed, or of all connections if the server is stopping
+     */
+    void reap(bool all);
+
+  public:
+    /**
+     * @param checksumThreads The amount of threads used to calculate checksums of every save, see SaveFile::setChecksumThreads()
+     */
+    Server(std::filesystem::path socketPath, size_t checksumThreads = 0);
+
+    Server(const Server &) = delete;
+    Server &operator=(const Server &) = delete;
+
+    ~Server();
+
+    /**
+     * @brief Listen on the socket until a client requests a shutdown, a stale socket file at the path is replaced
+     * @throw exception If the socket could not be created
+     */
+    void run();
+};
@@ -0,0 +1,369 @@
+#include "../arguments.h"
+#include "../backup.h"
+#include "../bench/savegenerator.h"
+#include "../itemlist.h"
+#include "../savecache.h"
+#include "../savefile/savefile.h"
+#include "../script.h"
+#include "../util.h"
+#include <array>
+#include <fstream>
+#include <source_location>
+#include <sstream>
+#include <unistd.h>
+
+/**
+ * @brief Round trips of the parts of the program that keep state, each test runs on generated save files in its own directory
+ * @note Run a single test by passing its name, ctest runs every test on its own
+ */
+namespace {
+
+/**
+ * @throw exception If the condition is false, naming the line of the check
+ */
+void Check(bool condition, std::source_location location = std::source_location::current()) {
+    if (!condition)
+        throw exception("check on line {} failed", location.line());
+}
+
+/**
+ * @brief Overwrite a byte of a file, without updating any checksum
+ */
+void CorruptByte(const std::filesystem::path &path, size_t offset) {
+    std::fstream file{path, std::ios::in | std::ios::out | std::ios::binary};
+    file.seekg(static_cast<std::streamoff>(offset));
+    const auto byte{static_cast<char>(file.get() ^ 0xFF)};
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.put(byte);
+    Check(file.good());
+}
+
+std::vector<u8> ReadFile(const std::filesystem::path &path) {
+    std::ifstream file{path, std::ios::binary};
+    return {std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{}};
+}
+
+/**
+ * @brief Owns the arguments of a command line, the parser only refers to them
+ */
+class CommandLine {
+  private:
+    std::vector<std::string> arguments;
+    std::vector<char *> pointers;
+
+  public:
+    CommandLine(std::initializer_list<std::string_view> words) : arguments{"erutils"} {
+        arguments.insert(arguments.end(), words.begin(), words.end());
+        for (auto &argument : arguments)
+            pointers.push_back(argument.data());
+    }
+    CommandLine(const CommandLine &) = delete;
+    CommandLine &operator=(const CommandLine &) = delete;
+
+    template <size_t N> CommandLineArguments::ArgumentParser<N> parse(const CommandLineArguments::Schema<N> &schema) {
+        return {schema, static_cast<int>(pointers.size()), pointers.data()};
+    }
+};
+
+size_t CountFiles(const std::filesystem::path &directory) {
+    return static_cast<size_t>(std::count_if(std::filesystem::recursive_directory_iterator{directory}, std::filesystem::recursive_directory_iterator{}, [](const auto &entry) {
+        return entry.is_regular_file();
+    }));
+}
+
+/**
+ * @brief Edit a generated save and write it both to a new file and in place, each written save is reloaded, verified and checked
+ * @param corrupt The offsets of bytes that are corrupted in the generated save before it is loaded
+ */
+template <typename Edit, typename Verify> void ForEachWrite(const std::filesystem::path &directory, size_t activeSlots, Edit &&edit, Verify &&check, std::initializer_list<size_t> corrupt = {}) {
+    const auto path{directory / "ER0000.sl2"};
+    SaveGenerator::WriteTo(path, activeSlots, 100);
+    for (const auto offset : corrupt)
+        CorruptByte(path, offset);
+
+    for (const auto inPlace : {false, true}) {
+        const auto copy{directory / fmt::format("copy-{}.sl2", inPlace)};
+        std::filesystem::copy_file(path, copy, std::filesystem::copy_options::overwrite_existing);
+        SaveFile saveFile{copy};
+        edit(saveFile);
+
+        const auto written{inPlace ? copy : directory / "written.sl2"};
+        saveFile.write(written, inPlace);
+        const SaveFile reloaded{written, MappedFile::Mode::ReadOnly};
+        Check(reloaded.verify().valid());
+        check(reloaded);
+    }
+}
+
+/**
+ * @brief A cached summary is used while the save is unchanged, touching or writing it makes the cache miss. A found save is remembered until the
+ * directory searched is modified
+ */
+void CacheHitMiss(const std::filesystem::path &directory) {
+    const auto steam{directory / "steam"};
+    const auto path{steam / "a" / "ER0000.sl2"};
+    std::filesystem::create_directories(path.parent_path());
+    SaveGenerator::WriteTo(path, 2, 100);
+
+    const auto cachePath{directory / "cache"};
+    {
+        SaveCache cache{cachePath};
+        Check(cache.find(steam, "ER0000.sl2").value == path);
+        const auto status{SaveCache::Status(path)};
+        Check(status && !cache.summary(path, *status));
+        cache.store(path, *status, SaveCache::Summary::Of(SaveFile{path, MappedFile::Mode::ReadOnly}));
+        cache.write();
+    }
+
+    const auto status{*SaveCache::Status(path)};
+    {
+        const SaveCache cache{cachePath};
+        const auto *summary{cache.summary(path, status)};
+        Check(summary && summary->steamId == SaveGenerator::SteamId);
+        Check(summary->slots[1].active && summary->slots[1].name == "Bench 1" && !summary->slots[2].active);
+    }
+
+    // Only the modification time changes, the size and inode stay the same
+    std::filesystem::last_write_time(path, std::filesystem::last_write_time(path) + std::chrono::seconds{1});
+    const auto touched{*SaveCache::Status(path)};
+    Check(touched.size == status.size && touched.inode == status.inode && !SaveCache{cachePath}.summary(path, touched));
+
+    {
+        SaveFile saveFile{path};
+        saveFile.renameSlot(1, "Renamed");
+        saveFile.write(path, true);
+    }
+    Check(!SaveCache{cachePath}.summary(path, *SaveCache::Status(path)));
+    Check(!SaveCache::Status(directory / "missing.sl2"));
+
+    // A save added without modifying the directory searched is not seen, removing the one that was found is
+    const auto modified{std::filesystem::last_write_time(steam)};
+    const auto other{steam / "b" / "ER0000.sl2"};
+    std::filesystem::create_directories(other.parent_path());
+    std::filesystem::copy_file(path, other);
+    std::filesystem::last_write_time(steam, modified);
+    Check(SaveCache{cachePath}.find(steam, "ER0000.sl2").value == path);
+    std::filesystem::remove_all(path.parent_path());
+    Check(SaveCache{cachePath}.find(steam, "ER0000.sl2").value == other);
+}
+
+/**
+ * @brief Both kinds of writes only rehash what was edited, the written save has valid checksums and keeps the edits
+ */
+void EditWriteVerify(const std::filesystem::path &directory) {
+    Items::Item item;
+    ForEachWrite(
+        directory, 3,
+        [&](SaveFile &saveFile) {
+            item = saveFile.items.begin()->item;
+            saveFile.setItem(1, item, 42);
+            saveFile.renameSlot(2, "Edited");
+        },
+        [&](const SaveFile &reloaded) {
+            Check(reloaded.getItem(1, item) == 42);
+            Check(reloaded.slotMetadata(2).name() == "Edited");
+        });
+}
+
+/**
+ * @brief Writing a save that was not modified recalculates every checksum, so one with stale checksums is repaired
+ */
+void RepairChecksums(const std::filesystem::path &directory) {
+    const auto slotData{SaveGenerator::SlotDataOffset(3) + 0x20000};   //!< A byte in the data of the fourth slot
+    const auto headerData{SaveGenerator::SaveHeaderOffset() + 0x1000}; //!< A byte in the save header
+
+    ForEachWrite(
+        directory, 4,
+        [](SaveFile &saveFile) {
+            const auto verification{saveFile.verify()};
+            Check(verification.corruptHeader && verification.corruptSlots == std::vector<size_t>{3});
+        },
+        [](const SaveFile &) {}, {slotData, headerData});
+}
+
+using CommandLineArguments::Option;
+
+constexpr CommandLineArguments::Schema TestOptions{std::array{
+    Option{"--slot", "<slot number>", "The slot"},
+    Option{"--set-item", "<item name> <amount>", "An item"}.repeated(),
+    Option{"--dry-run", "A flag"},
+}};
+
+/**
+ * @brief The parser finds every option with its values in a single pass and rejects command lines that do not match the schema
+ */
+void ArgumentParsing(const std::filesystem::path &) {
+    CommandLine commandLine{"--set-item", "Golden Seed", "5", "--slot", "3", "--dry-run", "--set-item", "Rune Arc", "x"};
+    const auto arguments{commandLine.parse(TestOptions)};
+    Check(arguments.size() == 9);
+    Check(arguments.get<int>(TestOptions["--slot"]).value == 3 && arguments.get<bool>(TestOptions["--dry-run"]).set);
+    Check(arguments.count(TestOptions["--set-item"]) == 2 && arguments.count(TestOptions["--slot"]) == 1);
+
+    std::vector<std::string_view> items;
+    arguments.forEach<std::pair<std::string_view, std::string_view>>(TestOptions["--set-item"], [&](const auto &item) {
+        items.push_back(item.first);
+        items.push_back(item.second);
+    });
+    Check(items == std::vector<std::string_view>{"Golden Seed", "5", "Rune Arc", "x"});
+
+    // Values are converted when they are requested, an option that was not given has no value
+    bool invalid{};
+    try {
+        arguments.get<std::pair<std::string_view, int>>(TestOptions["--set-item"]);
+    } catch (const std::exception &) {
+        invalid = true;
+    }
+    Check(invalid);
+    CommandLine empty{};
+    Check(!empty.parse(TestOptions).get<int>(TestOptions["--slot"]).set);
+
+    using Words = std::initializer_list<std::string_view>;
+    for (const auto words : {Words{"--unknown"}, Words{"--slot"}, Words{"--set-item", "Golden Seed"}, Words{"--slot", "1", "--slot", "2"}}) {
+        bool thrown{};
+        CommandLine rejected{words};
+        try {
+            rejected.parse(TestOptions);
+        } catch (const std::exception &) {
+            thrown = true;
+        }
+        Check(thrown);
+    }
+}
+
+/**
+ * @brief Backups restore the exact bytes that were backed up, also of a slot whose checksum does not match its data, and a second backup only
+ * stores the chunks that changed
+ */
+void BackupRestore(const std::filesystem::path &directory) {
+    const auto slotData{SaveGenerator::SlotDataOffset(5) + 0x20000}; //!< A byte in the data of the sixth slot
+
+    const auto path{directory / "ER0000.sl2"};
+    const auto original{SaveGenerator::WriteTo(path, 3, 100)};
+    std::filesystem::copy_file(path, directory / "ER0000.sl2.bak");
+    const BackupStore store{directory / "store"};
+    const auto first{store.backup(path, SaveFile::BackupChunks())};
+    Check(!std::filesystem::exists(directory / "ER0000.sl2.bak"));
+    const auto chunks{CountFiles(directory / "store" / "chunks")};
+
+    {
+        SaveFile saveFile{path};
+        saveFile.setItem(1, saveFile.items.begin()->item, 42);
+        saveFile.write(path, true);
+    }
+    CorruptByte(path, slotData);
+    const auto modified{ReadFile(path)};
+    const auto second{store.backup(path, SaveFile::BackupChunks())};
+    // The data and checksum of the edited slot are new, the corrupt slot still has the checksum of a stored chunk but different data
+    Check(CountFiles(directory / "store" / "chunks") == chunks + 3);
+
+    const auto restored{directory / "restored.sl2"};
+    store.restore(first, restored);
+    Check(ReadFile(restored) == original);
+    store.restore(second, restored);
+    Check(ReadFile(restored) == modified);
+}
+
+/**
+ * @brief An item list is resolved against the catalog, amounts that do not fit into the single byte of a record are rejected with their line
+ */
+void ItemListAmounts(const std::filesystem::path &) {
+    const Items::Items catalog;
+    std::istringstream valid{"# amounts\ngolden-seed = 255\nall SmithingStone=3\n"};
+    const ItemList items{valid, "test", catalog};
+    Check(items.size() > 1 && items.items()[0].item.key() == catalog["golden-seed"].key() && items.items()[0].quantity == 255);
+
+    for (const auto line : {"golden-seed=256", "golden-seed=300", "golden-seed=-1", "golden-seed=5x"}) {
+        std::istringstream input{fmt::format("golden-seed=1\n{}\n", line)};
+        std::string message;
+        try {
+            const ItemList rejected{input, "test", catalog};
+        } catch (const std::exception &error) {
+            message = error.what();
+        }
+        Check(message.starts_with("test:2: "));
+    }
+}
+
+/**
+ * @brief A script with an invalid argument on its last line is rejected before anything is applied
+ */
+void ScriptValidation(const std::filesystem::path &) {
+    for (const auto line : {"set-item 1 golden-sed 5", "set-item 10 golden-seed 5", "set-item 1 golden-seed 5x", "copy 0 10", "set-active 1 maybe"}) {
+        std::istringstream input{fmt::format("rename 0 Valid\nset-item 1 golden-seed 5\n{}\n", line)};
+        bool rejected{};
+        try {
+            const Script script{input, "test"};
+        } catch (const std::exception &) {
+            rejected = true;
+        }
+        Check(rejected);
+    }
+
+    std::istringstream valid{"rename 0 Valid\nset-item 1 golden-seed 5\nimport other.sl2 3 4\nset-active 2 false\n"};
+    Check(Script{valid, "test"}.size() == 4);
+}
+
+/**
+ * @brief Undoing a transaction keeps an edit made outside of it after it was committed, the written save has valid checksums for both
+ */
+void UndoMixedEdit(const std::filesystem::path &directory) {
+    Items::Item item;
+    u32 original{};
+    ForEachWrite(
+        directory, 2,
+        [&](SaveFile &saveFile) {
+            item = saveFile.items.begin()->item;
+            original = saveFile.getItem(0, item);
+            saveFile.transact([&]() {
+                saveFile.setItem(0, item, 50);
+            });
+            saveFile.setItem(1, item, 60);
+            Check(saveFile.undo());
+            Check(saveFile.getItem(0, item) == original);
+            Check(saveFile.getItem(1, item) == 60);
+        },
+        [&](const SaveFile &reloaded) {
+            Check(reloaded.getItem(0, item) == original);
+            Check(reloaded.getItem(1, item) == 60);
+        });
+}
+
+struct Test {
+    std::string_view name;
+    void (*run)(const std::filesystem::path &directory);
+};
+
+constexpr std::array Tests{
+    Test{"argument-parsing", ArgumentParsing},
+    Test{"backup-restore", BackupRestore},
+    Test{"cache-hit-miss", CacheHitMiss},
+    Test{"edit-write-verify", EditWriteVerify},
+    Test{"item-list-amounts", ItemListAmounts},
+    Test{"repair-checksums", RepairChecksums},
+    Test{"script-validation", ScriptValidation},
+    Test{"undo-mixed-edit", UndoMixedEdit},
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const std::span<char *> names{argv + 1, static_cast<size_t>(argc - 1)};
+    size_t failed{};
+    for (const auto &test : Tests) {
+        if (!names.empty() && std::find(names.begin(), names.end(), test.name) == names.end())
+            continue;
+
+        const auto directory{std::filesystem::temp_directory_path() / fmt::format("erutils-test-{}-{}", getpid(), test.name)};
+        std::filesystem::create_directories(directory);
+        try {
+            test.run(directory);
+            fmt::print("ok {}\n", test.name);
+        } catch (const std::exception &error) {
+            fmt::print("FAILED {}: {}\n", test.name, error.what());
+            failed++;
+        }
+        std::error_code error;
+        std::filesystem::remove_all(directory, error);
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,44 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    if (!threadCount)
+        threadCount = DefaultThreadCount();
+    if (threadCount == 1)
+        return; // Tasks are executed inline
+
+    workers.reserve(threadCount);
+    for (size_t i{}; i < threadCount; i++)
+        workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::scoped_lock lock{mutex};
+        stopping = true;
+    }
+    condition.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+size_t ThreadPool::DefaultThreadCount() {
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void ThreadPool::work() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock{mutex};
+            condition.wait(lock, [this]() {
+                return stopping || !tasks.empty();
+            });
+            if (tasks.empty())
+                return;
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
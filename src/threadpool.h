@@ -0,0 +1,70 @@
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#pragma once
+
+/**
+ * @brief A fixed size pool of worker threads executing submitted tasks in order
+ * @note A pool with a single thread runs every task on the submitting thread, which keeps profiles reproducible
+ */
+class ThreadPool {
+  private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping{false};
+
+    void work();
+
+  public:
+    /**
+     * @param threadCount The amount of worker threads, 0 uses DefaultThreadCount()
+     */
+    explicit ThreadPool(size_t threadCount = 0);
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /**
+     * @brief Finish all queued tasks and join the workers
+     */
+    ~ThreadPool();
+
+    /**
+     * @brief The amount of threads available on this machine
+     */
+    static size_t DefaultThreadCount();
+
+    size_t size() const {
+        return workers.empty() ? 1 : workers.size();
+    }
+
+    /**
+     * @brief Queue a task, exceptions it throws are rethrown by the returned future
+     */
+    template <typename Function> auto submit(Function &&function) -> std::future<std::invoke_result_t<Function>> {
+        using Result = std::invoke_result_t<Function>;
+        auto task{std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function))};
+        auto future{task->get_future()};
+        if (workers.empty()) {
+            (*task)();
+            return future;
+        }
+
+        {
+            std::scoped_lock lock{mutex};
+            tasks.emplace_back([task]() {
+                (*task)();
+            });
+        }
+        condition.notify_one();
+        return future;
+    }
+};
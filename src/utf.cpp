@@ -0,0 +1,198 @@
+#include "util.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define HAS_SSE2_UTF 1
+#elif defined(__ARM_NEON) && defined(__aarch64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define HAS_NEON_UTF 1
+#endif
+
+namespace util {
+
+namespace {
+
+constexpr size_t NarrowBlock{8}; //!< The amount of UTF-16 code units converted at once by the ASCII fast path
+constexpr size_t WidenBlock{16}; //!< The amount of UTF-8 bytes converted at once by the ASCII fast path
+constexpr char32_t ReplacementCharacter{0xFFFD};
+
+/**
+ * @brief Convert a block of NarrowBlock code units if they are all ASCII, a null character counts as non-ASCII so the terminator is never skipped
+ * @return If the block was converted, otherwise nothing is written
+ */
+inline bool NarrowAscii([[maybe_unused]] const u8 *units, [[maybe_unused]] char *output) {
+#ifdef HAS_SSE2_UTF
+    const auto block{_mm_loadu_si128(reinterpret_cast<const __m128i *>(units))};
+    const auto zero{_mm_setzero_si128()};
+    const auto ascii{_mm_cmpeq_epi16(_mm_and_si128(block, _mm_set1_epi16(static_cast<short>(0xFF80))), zero)};
+    const auto null{_mm_cmpeq_epi16(block, zero)};
+    if (_mm_movemask_epi8(_mm_andnot_si128(null, ascii)) != 0xFFFF)
+        return false;
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(output), _mm_packus_epi16(block, block));
+    return true;
+#elif defined(HAS_NEON_UTF)
+    const auto block{vreinterpretq_u16_u8(vld1q_u8(units))};
+    if (vmaxvq_u16(block) >= 0x80 || vminvq_u16(block) == 0)
+        return false;
+    vst1_u8(reinterpret_cast<u8 *>(output), vmovn_u16(block));
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Convert a block of WidenBlock bytes if they are all ASCII and not null
+ * @return If the block was converted, otherwise nothing is written
+ */
+inline bool WidenAscii([[maybe_unused]] const char *text, [[maybe_unused]] u8 *output) {
+#ifdef HAS_SSE2_UTF
+    const auto block{_mm_loadu_si128(reinterpret_cast<const __m128i *>(text))};
+    const auto zero{_mm_setzero_si128()};
+    if (_mm_movemask_epi8(block) || _mm_movemask_epi8(_mm_cmpeq_epi8(block, zero)))
+        return false;
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output), _mm_unpacklo_epi8(block, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(output + WidenBlock), _mm_unpackhi_epi8(block, zero));
+    return true;
+#elif defined(HAS_NEON_UTF)
+    const auto block{vld1q_u8(reinterpret_cast<const u8 *>(text))};
+    if (vmaxvq_u8(block) >= 0x80 || vminvq_u8(block) == 0)
+        return false;
+    const auto zero{vdupq_n_u8(0)};
+    vst1q_u8(output, vzip1q_u8(block, zero));
+    vst1q_u8(output + WidenBlock, vzip2q_u8(block, zero));
+    return true;
+#else
+    return false;
+#endif
+}
+
+inline char16_t ReadUnit(std::span<const u8> text, size_t index) {
+    return static_cast<char16_t>(text[index * 2] | (text[index * 2 + 1] << 8));
+}
+
+/**
+ * @brief Append the UTF-8 encoding of a code point
+ * @return The amount of bytes written
+ */
+inline size_t EncodeUtf8(char32_t codePoint, char *output) {
+    if (codePoint < 0x80) {
+        output[0] = static_cast<char>(codePoint);
+        return 1;
+    } else if (codePoint < 0x800) {
+        output[0] = static_cast<char>(0xC0 | (codePoint >> 6));
+        output[1] = static_cast<char>(0x80 | (codePoint & 0x3F));
+        return 2;
+    } else if (codePoint < 0x10000) {
+        output[0] = static_cast<char>(0xE0 | (codePoint >> 12));
+        output[1] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+        output[2] = static_cast<char>(0x80 | (codePoint & 0x3F));
+        return 3;
+    }
+    output[0] = static_cast<char>(0xF0 | (codePoint >> 18));
+    output[1] = static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+    output[2] = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+    output[3] = static_cast<char>(0x80 | (codePoint & 0x3F));
+    return 4;
+}
+
+/**
+ * @brief Decode the code point starting at index, advancing index past it
+ * @throw exception If the bytes are not a valid, shortest form encoding of a scalar value
+ */
+char32_t DecodeUtf8(std::string_view text, size_t &index) {
+    constexpr std::array<char32_t, 5> Minimum{0, 0, 0x80, 0x800, 0x10000}; //!< The smallest code point for every encoded length, anything below is an overlong encoding
+
+    const auto lead{static_cast<u8>(text[index])};
+    if (lead < 0x80) {
+        index++;
+        return lead;
+    }
+
+    // The length of a character is encoded by the amount of leading ones in its first byte
+    const auto length{static_cast<size_t>(std::countl_one(lead))};
+    if (length < 2 || length > 4)
+        throw exception("Invalid UTF-8 byte 0x{:02X} at offset {} of '{}'", lead, index, text);
+    char32_t codePoint{static_cast<char32_t>(lead & (0x7F >> length))};
+
+    if (index + length > text.size())
+        throw exception("Truncated UTF-8 character at offset {} of '{}'", index, text);
+    for (size_t i{1}; i < length; i++) {
+        const auto continuation{static_cast<u8>(text[index + i])};
+        if ((continuation & 0xC0) != 0x80)
+            throw exception("Invalid UTF-8 byte 0x{:02X} at offset {} of '{}'", continuation, index + i, text);
+        codePoint = (codePoint << 6) | (continuation & 0x3F);
+    }
+
+    if (codePoint < Minimum[length] || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint < 0xE000))
+        throw exception("Invalid UTF-8 character at offset {} of '{}'", index, text);
+    index += length;
+    return codePoint;
+}
+
+} // namespace
+
+size_t Utf16ToUtf8(std::span<const u8> text, std::span<char> output) {
+    if (output.size() < Utf8Capacity(text.size()))
+        throw exception("A buffer of {} bytes cannot hold the UTF-8 conversion of {} bytes of UTF-16", output.size(), text.size());
+
+    const auto units{text.size() / sizeof(char16_t)};
+    size_t index{};
+    size_t written{};
+    while (index < units) {
+        if (index + NarrowBlock <= units && NarrowAscii(text.data() + index * sizeof(char16_t), output.data() + written)) {
+            index += NarrowBlock;
+            written += NarrowBlock;
+            continue;
+        }
+
+        // The block is converted one character at a time before trying the fast path again
+        for (const auto blockEnd{std::min(index + NarrowBlock, units)}; index < blockEnd;) {
+            char32_t codePoint{ReadUnit(text, index++)};
+            if (!codePoint)
+                return written;
+
+            if (codePoint >= 0xD800 && codePoint < 0xDC00 && index < units && ReadUnit(text, index) >= 0xDC00 && ReadUnit(text, index) < 0xE000)
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (ReadUnit(text, index++) - 0xDC00);
+            else if (codePoint >= 0xD800 && codePoint < 0xE000)
+                codePoint = ReplacementCharacter; // Unpaired surrogates cannot be represented in UTF-8
+            written += EncodeUtf8(codePoint, output.data() + written);
+        }
+    }
+    return written;
+}
+
+void Utf8ToUtf16(std::string_view text, std::span<u8> output) {
+    const auto capacity{output.size() / sizeof(char16_t)};
+    size_t units{};
+    const auto store{[&](char32_t unit) {
+        if (units + 1 >= capacity) // The last unit is reserved for the terminator
+            throw exception("'{}' is longer than {} UTF-16 characters", text, capacity ? capacity - 1 : 0);
+        output[units * 2] = static_cast<u8>(unit);
+        output[units * 2 + 1] = static_cast<u8>(unit >> 8);
+        units++;
+    }};
+
+    for (size_t index{}; index < text.size();) {
+        if (index + WidenBlock <= text.size() && units + WidenBlock < capacity && WidenAscii(text.data() + index, output.data() + units * sizeof(char16_t))) {
+            index += WidenBlock;
+            units += WidenBlock;
+            continue;
+        }
+
+        const auto codePoint{DecodeUtf8(text, index)};
+        if (!codePoint)
+            throw exception("'{}' contains a null character", text);
+        if (codePoint >= 0x10000) {
+            store(0xD800 + ((codePoint - 0x10000) >> 10));
+            store(0xDC00 + ((codePoint - 0x10000) & 0x3FF));
+        } else
+            store(codePoint);
+    }
+    std::fill(output.begin() + static_cast<std::ptrdiff_t>(units * sizeof(char16_t)), output.end(), 0);
+}
+
+} // namespace util
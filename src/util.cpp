@@ -1,43 +1,357 @@
 #include "util.h"
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <functional>
-#include <openssl/evp.h>
 #include <span>
+#include <utility>
+
+#if __has_include(<unistd.h>)
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+void Section::replace(std::span<u8> data, const std::span<u8> newSection, DirtyRegions &dirty) const {
+    dirty.mark(*this);
+    replace(data, newSection);
+}
+
+void DirtyRegions::mark(size_t address, size_t size) {
+    if (!size)
+        return;
+    if (snapshot)
+        snapshot->save(address, size);
+
+    // Find the first region that ends at or after the new one starts, everything from there on that starts before the new one ends gets merged
+    auto first{std::lower_bound(regions.begin(), regions.end(), address, [](const Section &region, size_t value) {
+        return region.length < value;
+    })};
+    auto last{first};
+    auto start{address};
+    auto end{address + size};
+    while (last != regions.end() && last->address <= end) {
+        start = std::min(start, last->address);
+        end = std::max(end, last->length);
+        last++;
+    }
+
+    first = regions.erase(first, last);
+    regions.insert(first, Section{start, end - start});
+}
+
+bool DirtyRegions::touches(const Section &section) const {
+    const auto region{std::lower_bound(regions.begin(), regions.end(), section.address, [](const Section &region, size_t value) {
+        return region.length <= value;
+    })};
+    return region != regions.end() && region->address < section.length;
+}
+
+void PageSnapshot::save(size_t address, size_t size) {
+    if (!size || address >= data.size())
+        return;
+    const auto last{std::min(address + size, data.size()) - 1};
+    for (auto page{address / PageSize}; page <= last / PageSize; page++) {
+        if (saved[page])
+            continue;
+        saved[page] = true;
+        pages.push_back(page);
+        const auto bytes{data.subspan(page * PageSize, std::min(PageSize, data.size() - page * PageSize))};
+        contents.insert(contents.end(), bytes.begin(), bytes.end());
+        contents.resize(pages.size() * PageSize);
+    }
+    touched.mark(address, size);
+}
+
+const std::vector<Section> &PageSnapshot::restore() const {
+    // Where each page is stored in contents, sorted by page so the ranges can be looked up in order
+    std::vector<std::pair<size_t, size_t>> stored(pages.size());
+    for (size_t i{}; i < pages.size(); i++)
+        stored[i] = {pages[i], i * PageSize};
+    std::sort(stored.begin(), stored.end());
+
+    auto page{stored.begin()};
+    for (const auto &range : touched.ranges())
+        for (auto address{range.address}; address < std::min(range.length, data.size());) {
+            const auto index{address / PageSize};
+            while (page->first < index)
+                page++;
+            const auto end{std::min({range.length, (index + 1) * PageSize, data.size()})};
+            const auto source{contents.begin() + static_cast<std::ptrdiff_t>(page->second + address - index * PageSize)};
+            std::copy(source, source + static_cast<std::ptrdiff_t>(end - address), data.begin() + static_cast<std::ptrdiff_t>(address));
+            address = end;
+        }
+    return touched.ranges();
+}
 
 namespace util {
 
-const Md5Hash GenerateMd5(std::span<u8> input) {
-    Md5Hash hash{};
-    auto context{EVP_MD_CTX_new()};
-    EVP_DigestInit_ex(context, EVP_md5(), nullptr);
-    EVP_DigestUpdate(context, input.data(), input.size_bytes());
-    EVP_DigestFinal_ex(context, hash.data(), nullptr);
-    return hash;
+FileStatus GetFileStatus(const std::filesystem::path &path) {
+#if __has_include(<unistd.h>)
+    struct stat status {};
+    if (stat(path.c_str(), &status) == -1)
+        throw exception("Could not get the status of '{}': {}", ToAbsolutePath(path).generic_string(), std::strerror(errno));
+#ifdef __APPLE__
+    const auto &modified{status.st_mtimespec};
+#else
+    const auto &modified{status.st_mtim};
+#endif
+    return {static_cast<u64>(status.st_dev), static_cast<u64>(status.st_ino), static_cast<u64>(status.st_size), static_cast<u64>(modified.tv_sec) * 1'000'000'000 + static_cast<u64>(modified.tv_nsec)};
+#else
+    const auto modified{std::chrono::duration_cast<std::chrono::nanoseconds>(std::filesystem::last_write_time(path).time_since_epoch())};
+    return {0, 0, std::filesystem::file_size(path), static_cast<u64>(modified.count())};
+#endif
 }
 
-class Utf8Utf16Converter : public std::codecvt<char16_t, char8_t, std::mbstate_t> {
-  public:
-    ~Utf8Utf16Converter() override = default;
-};
+std::vector<u8> ReadRanges(const std::filesystem::path &path, std::span<const Section> ranges) {
+    size_t bytes{};
+    for (const auto &range : ranges)
+        bytes += range.size;
+    PROFILE_SCOPE("read ranges", bytes);
+    std::vector<u8> buffer(bytes);
+    const auto failed{[&path](const Section &range) {
+        return exception("Failed to read 0x{:X} bytes at 0x{:X} from '{}'", range.size, range.address, ToAbsolutePath(path).generic_string());
+    }};
 
-const std::string Utf16ToUtf8String(std::span<u8> chars) {
-    std::u16string_view text{reinterpret_cast<const char16_t *>(chars.data()), chars.size_bytes() / sizeof(char16_t)};
-    std::span<char8_t> u8chars(reinterpret_cast<char8_t *>(chars.data()), chars.size_bytes() / sizeof(char8_t));
-    Utf8Utf16Converter::state_type convert_state;
-    const char16_t *from_next;
-    char8_t *to_next;
-    Utf8Utf16Converter().out(convert_state, text.data(), text.end(), from_next, u8chars.data(), u8chars.end().base(), to_next);
-    // Null terminate the string, if it isn't out of bounds
-    if (to_next < reinterpret_cast<const char8_t *>(text.end()))
-        *to_next = u8'\0';
+#if __has_include(<unistd.h>)
+    const auto fd{open(path.c_str(), O_RDONLY)};
+    if (fd == -1)
+        throw exception("Could not open file '{}': {}", ToAbsolutePath(path).generic_string(), std::strerror(errno));
 
-    return std::string().assign(u8chars.data(), to_next);
+    size_t offset{};
+    for (const auto &range : ranges) {
+        for (size_t read{}; read < range.size;) {
+            const auto result{pread(fd, buffer.data() + offset + read, range.size - read, static_cast<off_t>(range.address + read))};
+            if (result == 0 || (result == -1 && errno != EINTR)) {
+                close(fd);
+                throw failed(range);
+            }
+            if (result > 0)
+                read += static_cast<size_t>(result);
+        }
+        offset += range.size;
+    }
+    close(fd);
+#else
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+        throw exception("Could not open file '{}'", ToAbsolutePath(path).generic_string());
+
+    size_t offset{};
+    for (const auto &range : ranges) {
+        file.seekg(static_cast<std::streamoff>(range.address));
+        file.read(reinterpret_cast<char *>(buffer.data() + offset), static_cast<std::streamsize>(range.size));
+        if (!file)
+            throw failed(range);
+        offset += range.size;
+    }
+#endif
+    return buffer;
+}
+
+void WriteRanges(std::filesystem::path path, std::span<u8> data, const std::vector<Section> &ranges) {
+    size_t bytes{};
+    for (const auto &range : ranges)
+        bytes += range.size;
+    PROFILE_SCOPE("write ranges", bytes);
+#if __has_include(<unistd.h>)
+    const auto fd{open(path.c_str(), O_WRONLY)};
+    if (fd == -1)
+        throw exception("Could not open file '{}': {}", ToAbsolutePath(path).generic_string(), std::strerror(errno));
+
+    for (const auto &range : ranges) {
+        const auto bytes{range.bytesFrom(data)};
+        size_t written{};
+        while (written < bytes.size_bytes()) {
+            const auto result{pwrite(fd, bytes.data() + written, bytes.size_bytes() - written, static_cast<off_t>(range.address + written))};
+            if (result == -1 && errno != EINTR) {
+                close(fd);
+                throw exception("Failed to write to '{}': {}", ToAbsolutePath(path).generic_string(), std::strerror(errno));
+            }
+            if (result > 0)
+                written += static_cast<size_t>(result);
+        }
+    }
+
+    if (close(fd) == -1)
+        throw exception("Failed to write to '{}': {}", ToAbsolutePath(path).generic_string(), std::strerror(errno));
+#else
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file.is_open())
+        throw exception("Could not open file '{}'", ToAbsolutePath(path).generic_string());
+
+    for (const auto &range : ranges) {
+        const auto bytes{range.bytesFrom(data)};
+        file.seekp(static_cast<std::streamoff>(range.address));
+        file.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size_bytes()));
+    }
+
+    file.close();
+    if (file.fail())
+        throw exception("Failed to write to '{}'", ToAbsolutePath(path).generic_string());
+#endif
 }
 
-void Utf8ToUtf16(std::span<u8> chars, std::u16string_view text) {
-    std::memcpy(chars.data(), text.data(), std::min(text.size() * sizeof(char16_t), chars.size_bytes()));
-    if (text.size() * sizeof(char16_t) > chars.size()) // Null terminate if the string if it isnt out of bounds
-        *(reinterpret_cast<char16_t *>(chars.data()) + text.size()) = u'\0';
+namespace {
+
+/**
+ * @brief Get a path next to the destination that no other writer uses, including other threads of this process
+ */
+std::filesystem::path TemporaryPathFor(const std::filesystem::path &destination) {
+    static std::atomic<u32> counter{};
+#if __has_include(<unistd.h>)
+    const auto process{static_cast<long>(getpid())};
+#else
+    const long process{};
+#endif
+    return destination.parent_path() / fmt::format(".{}.{}-{}.tmp", destination.filename().string(), process, counter++);
+}
+
+} // namespace
+
+AtomicFile::AtomicFile(std::filesystem::path path) : destination{std::filesystem::is_symlink(path) ? std::filesystem::canonical(path) : path}, temporary{TemporaryPathFor(destination)} {
+#if __has_include(<unistd.h>)
+    fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (fd == -1)
+        throw exception("Could not create file '{}': {}", ToAbsolutePath(temporary).generic_string(), std::strerror(errno));
+
+    // Keep the permissions of the file that is replaced, a new file gets the default ones
+    struct stat status {};
+    if (stat(destination.c_str(), &status) == 0)
+        fchmod(fd, status.st_mode & 07777);
+#else
+    file.open(temporary, std::ios::out | std::ios::binary);
+    if (!file.is_open())
+        throw exception("Could not create file '{}'", ToAbsolutePath(temporary).generic_string());
+#endif
+}
+
+AtomicFile::~AtomicFile() {
+#if __has_include(<unistd.h>)
+    if (fd == -1)
+        return;
+    close(fd);
+#else
+    if (!file.is_open())
+        return;
+    file.close();
+#endif
+    std::error_code error;
+    std::filesystem::remove(temporary, error);
+}
+
+void AtomicFile::write(std::span<const u8> data, size_t offset) {
+#if __has_include(<unistd.h>)
+    size_t written{};
+    while (written < data.size_bytes()) {
+        const auto result{pwrite(fd, data.data() + written, data.size_bytes() - written, static_cast<off_t>(offset + written))};
+        if (result == -1 && errno != EINTR)
+            throw exception("Failed to write to '{}': {}", ToAbsolutePath(temporary).generic_string(), std::strerror(errno));
+        if (result > 0)
+            written += static_cast<size_t>(result);
+    }
+#else
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.write(reinterpret_cast<const char *>(data.data()), static_cast<std::streamsize>(data.size_bytes()));
+    if (file.fail())
+        throw exception("Failed to write to '{}'", ToAbsolutePath(temporary).generic_string());
+#endif
+}
+
+void AtomicFile::copy(const std::filesystem::path &source, size_t sourceOffset, size_t size, size_t offset) {
+#if __has_include(<unistd.h>)
+    const auto input{open(source.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (input == -1)
+        throw exception("Could not open file '{}': {}", ToAbsolutePath(source).generic_string(), std::strerror(errno));
+
+    try {
+        size_t copied{};
+#ifdef __linux__
+        while (copied < size) {
+            auto inputOffset{static_cast<off_t>(sourceOffset + copied)}, outputOffset{static_cast<off_t>(offset + copied)};
+            const auto result{copy_file_range(input, &inputOffset, fd, &outputOffset, size - copied, 0)};
+            if (result > 0)
+                copied += static_cast<size_t>(result);
+            else if (result == 0 || errno != EINTR)
+                break; // Copying between these files is not supported, or the source is shorter than expected. Either way the fallback below takes care of it
+        }
+#endif
+
+        std::vector<u8> buffer(std::min<size_t>(size - copied, 0x100000));
+        while (copied < size) {
+            const auto result{pread(input, buffer.data(), std::min(buffer.size(), size - copied), static_cast<off_t>(sourceOffset + copied))};
+            if (result == -1 && errno == EINTR)
+                continue;
+            if (result <= 0)
+                throw exception("Failed to read 0x{:X} bytes at 0x{:X} from '{}'", size, sourceOffset, ToAbsolutePath(source).generic_string());
+            write(std::span{buffer}.first(static_cast<size_t>(result)), offset + copied);
+            copied += static_cast<size_t>(result);
+        }
+    } catch (...) {
+        close(input);
+        throw;
+    }
+    close(input);
+#else
+    std::ifstream input{source, std::ios::in | std::ios::binary};
+    std::vector<u8> buffer(size);
+    input.seekg(static_cast<std::streamoff>(sourceOffset));
+    input.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(size));
+    if (!input)
+        throw exception("Failed to read 0x{:X} bytes at 0x{:X} from '{}'", size, sourceOffset, ToAbsolutePath(source).generic_string());
+    write(buffer, offset);
+#endif
+}
+
+void AtomicFile::commit() {
+    PROFILE_SCOPE("sync");
+#if __has_include(<unistd.h>)
+    if (fsync(fd) == -1 || close(std::exchange(fd, -1)) == -1) {
+        std::error_code error;
+        std::filesystem::remove(temporary, error);
+        throw exception("Failed to write to '{}': {}", ToAbsolutePath(temporary).generic_string(), std::strerror(errno));
+    }
+#else
+    file.close();
+    if (file.fail())
+        throw exception("Failed to write to '{}'", ToAbsolutePath(temporary).generic_string());
+#endif
+
+    std::error_code error;
+    std::filesystem::rename(temporary, destination, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+        throw exception("Failed to replace '{}': {}", ToAbsolutePath(destination).generic_string(), error.message());
+    }
+
+#if __has_include(<unistd.h>)
+    // The rename itself is only durable once the directory containing it has been flushed
+    const auto parent{destination.has_parent_path() ? destination.parent_path() : std::filesystem::path{"."}};
+    const auto directory{open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+    if (directory != -1) {
+        fsync(directory);
+        close(directory);
+    }
+#endif
+}
+
+std::string_view Trim(std::string_view text) {
+    const auto start{text.find_first_not_of(Whitespace)};
+    if (start == std::string_view::npos)
+        return {};
+    return text.substr(start, text.find_last_not_of(Whitespace) - start + 1);
+}
+
+size_t ToSlot(std::string_view text, size_t slotCount) {
+    const auto slot{ToNumber<size_t>(text)};
+    if (slot >= slotCount)
+        throw exception("Invalid slot index {}", slot);
+    return slot;
 }
 
 const std::string SecondsToTimeStamp(const time_t input) {
@@ -77,6 +391,19 @@ Maybe<std::filesystem::path> FindFileInSubDirectory(std::filesystem::path direct
     return fmt::format("Could not find file '{}' in any subdirectory of '{}'", filename, directory.string());
 }
 
+std::vector<std::filesystem::path> FindFilesInSubDirectories(std::filesystem::path directory, std::string_view filename) {
+    std::vector<std::filesystem::path> files;
+    std::error_code error;
+    for (std::filesystem::recursive_directory_iterator iterator{directory, std::filesystem::directory_options::skip_permission_denied, error}, end; !error && iterator != end; iterator.increment(error))
+        if (iterator->path().filename() == filename && iterator->is_regular_file(error))
+            files.push_back(iterator->path());
+    if (error)
+        throw exception("Failed to search '{}': {}", directory.string(), error.message());
+
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
 u64 GetSteamId(std::filesystem::path saveFilePath) {
     u64 steamId;
     try {
@@ -103,31 +430,4 @@ std::filesystem::path CreateDataDirectory() {
     return directory;
 }
 
-std::filesystem::path CreateBackupDirectory() {
-    auto directory{CreateDataDirectory() / "backup"};
-    const auto timePoint{std::chrono::system_clock::to_time_t(std::chrono::system_clock::now())};
-    auto timeStamp{fmt::format("{}", std::ctime(&timePoint))}; // TODO: format this in a better way
-    timeStamp.pop_back();                                      // remove newline, thanks ctime
-    if (!std::filesystem::exists(directory))
-        std::filesystem::create_directory(directory);
-
-    directory /= timeStamp;
-    if (!std::filesystem::exists(directory))
-        std::filesystem::create_directory(directory);
-    return directory;
-}
-
-std::filesystem::path BackupSavefile(std::filesystem::path saveFilePath) {
-    auto backupDir{util::CreateBackupDirectory()};
-    std::filesystem::path bakFilePath{saveFilePath.string() + ".bak"};
-    if (std::filesystem::exists(saveFilePath))
-        std::filesystem::copy(saveFilePath, backupDir / saveFilePath.filename());
-    if (std::filesystem::exists(bakFilePath)) {
-        std::filesystem::copy(bakFilePath, backupDir / bakFilePath.filename());
-        std::filesystem::remove(bakFilePath); // If this differentiates from ER0000.sl2 the game will claim the savefile is corrupt
-    }
-
-    return backupDir;
-}
-
 } // namespace util
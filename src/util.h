@@ -1,9 +1,14 @@
+#include <charconv>
 #include <filesystem>
 #include <fmt/format.h>
+#include <fstream>
 #include <functional>
+#include <iterator>
+#include <openssl/evp.h>
 #include <openssl/md5.h>
 #include <span>
 #include <stdexcept>
+#include <vector>
 
 #pragma once
 
@@ -34,6 +39,9 @@ class exception : public std::runtime_error {
     template <typename S, typename... Args> exception(const S &formatStr, Args &&...args) : runtime_error(Format(formatStr, args...)) {}
 };
 
+class DirtyRegions;
+class PageSnapshot;
+
 /**
  * @brief An object representing a range of bytes in a file with some utility functions
  */
@@ -71,6 +79,11 @@ struct Section {
         std::copy(newSection.begin(), newSection.end(), data.begin() + address);
     }
 
+    /**
+     * @brief Replace a section inside of the save file and record the modified range
+     */
+    void replace(std::span<u8> data, const std::span<u8> newSection, DirtyRegions &dirty) const;
+
     template <class C> constexpr void replace(std::span<u8> data, C newString) const {
         if (newString.size() < size)
             std::fill(data.begin() + address + newString.size(), data.begin() + address + size, 0); // 0 fill the remainder of the section
@@ -90,6 +103,90 @@ struct Section {
     std::string_view stringFrom(const std::span<u8> data) const {
         return {reinterpret_cast<const char *>(bytesFrom(data).data()), size};
     }
+
+    constexpr bool overlaps(const Section &other) const {
+        return address < other.length && other.address < length;
+    }
+};
+
+/**
+ * @brief A sorted set of byte ranges that have been modified, adjacent or overlapping ranges are merged
+ */
+class DirtyRegions {
+  private:
+    std::vector<Section> regions;
+    PageSnapshot *snapshot{}; //!< Saves the pages of every marked range before they are modified, see record()
+
+  public:
+    /**
+     * @brief Record that a range of bytes is about to be modified
+     */
+    void mark(size_t address, size_t size);
+
+    void mark(const Section &section) {
+        mark(section.address, section.size);
+    }
+
+    /**
+     * @brief Check if any modified range overlaps with the given section
+     */
+    bool touches(const Section &section) const;
+
+    const std::vector<Section> &ranges() const {
+        return regions;
+    }
+
+    bool empty() const {
+        return regions.empty();
+    }
+
+    void clear() {
+        regions.clear();
+    }
+
+    /**
+     * @brief Save the pages of every range that is marked from now on in a snapshot, nullptr stops recording
+     */
+    void record(PageSnapshot *target) {
+        snapshot = target;
+    }
+};
+
+/**
+ * @brief Copies of the 4 KB pages of a buffer taken the first time something in them is modified, so the modifications can be undone
+ * @note Undoing costs the pages that were touched rather than a copy of the whole buffer
+ */
+class PageSnapshot {
+  public:
+    constexpr static size_t PageSize{4096};
+
+  private:
+    std::span<u8> data;
+    std::vector<bool> saved;   //!< If the page at the index is in contents
+    std::vector<size_t> pages; //!< The index of every saved page, in the order they were saved
+    std::vector<u8> contents;  //!< The saved pages one after another, the last page of the buffer is padded to a full page
+    DirtyRegions touched;      //!< The exact ranges that were modified, only these are restored
+
+  public:
+    explicit PageSnapshot(std::span<u8> data) : data{data}, saved((data.size() + PageSize - 1) / PageSize) {}
+
+    /**
+     * @brief Save the pages of a range that is about to be modified, pages that were saved before keep their first contents
+     */
+    void save(size_t address, size_t size);
+
+    /**
+     * @brief Copy the saved contents of every modified range back into the buffer
+     * @return The restored ranges in ascending order
+     */
+    const std::vector<Section> &restore() const;
+
+    /**
+     * @brief The amount of bytes held by the snapshot
+     */
+    size_t size() const {
+        return contents.size();
+    }
 };
 
 /**
@@ -118,30 +215,208 @@ template <class C> constexpr u32 getDigits(C input) {
 }
 
 /**
- * @brief Replace all occurances of a span inside of another span
+ * @brief Print to stdout, or append to output if it is set
+ * @note This lets tasks running in parallel collect their output instead of interleaving it
  */
-template <typename T, class C> constexpr void ReplaceAll(std::span<T> data, std::span<T> find, C replace) {
-    size_t index{};
-    if (find.size_bytes() != replace.size())
-        throw exception("Size of find does not match replace");
+template <typename... Args> void Print(fmt::memory_buffer *output, fmt::format_string<Args...> format, Args &&...args) {
+    if (output)
+        fmt::format_to(std::back_inserter(*output), format, std::forward<Args>(args)...);
+    else
+        fmt::print(format, std::forward<Args>(args)...);
+}
 
-    while (true) {
-        auto itr{std::search(data.begin() + index, data.end(), find.begin(), find.end())};
-        if (itr == data.end())
-            break;
+constexpr std::string_view Whitespace{" \t\r"}; //!< What Trim() removes, a line read with std::getline may still end with '\r'
 
-        std::copy(replace.begin(), replace.end(), itr);
-        index = itr - data.begin() + 1;
-    }
+/**
+ * @brief Remove the whitespace at both ends of the text
+ */
+std::string_view Trim(std::string_view text);
+
+/**
+ * @brief Convert all of the text to a number
+ * @throw exception If the text is not a number of the type, or has anything after it
+ */
+template <typename T> T ToNumber(std::string_view text) {
+    T number{};
+    const auto [end, error]{std::from_chars(text.data(), text.data() + text.size(), number)};
+    if (text.empty() || error != std::errc{} || end != text.data() + text.size())
+        throw exception("Invalid number '{}'", text);
+    return number;
 }
 
+/**
+ * @brief Convert the text to the index of a slot
+ * @param slotCount The number of slots, see SaveFile::SlotCount
+ * @throw exception If the text is not a number or there is no slot with the index
+ */
+size_t ToSlot(std::string_view text, size_t slotCount);
+
+/**
+ * @brief A pattern to replace with ReplaceAll, both sides have to be the same size
+ * @note The bytes are owned so a pattern can be taken from the data it is replaced in
+ */
+struct Replacement {
+    std::vector<u8> find;
+    std::vector<u8> replace;
+
+    Replacement(std::span<const u8> find, std::span<const u8> replace) : find{find.begin(), find.end()}, replace{replace.begin(), replace.end()} {}
+};
+
+/**
+ * @brief Replace all occurances of multiple patterns in a single pass over the data
+ * @param dirty If set, every replaced range gets recorded in it before it is modified
+ * @return The offsets of all replaced matches in ascending order
+ * @note Candidates are found by a SIMD filter on the first and last byte of every pattern and then verified. Matches are checked against the data as it is being rewritten, if multiple patterns match at the same offset the first one is used
+ */
+std::vector<size_t> ReplaceAll(std::span<u8> data, std::span<const Replacement> replacements, DirtyRegions *dirty = nullptr);
+
+inline std::vector<size_t> ReplaceAll(std::span<u8> data, std::span<const u8> find, std::span<const u8> replace, DirtyRegions *dirty = nullptr) {
+    const Replacement replacement{find, replace};
+    return ReplaceAll(data, std::span{&replacement, 1}, dirty);
+}
+
+/**
+ * @brief What identifies a version of a file without reading it
+ */
+struct FileStatus {
+    u64 device;
+    u64 inode;
+    u64 size;
+    u64 modified; //!< The modification time in nanoseconds
+
+    bool operator==(const FileStatus &) const = default;
+};
+
+/**
+ * @brief Get the status of a file with a single stat call
+ * @note Where stat is not available the device and inode are always 0
+ */
+FileStatus GetFileStatus(const std::filesystem::path &path);
+
+/**
+ * @brief Read the given ranges of a file
+ * @return The contents of the ranges, one after another in the given order
+ */
+std::vector<u8> ReadRanges(const std::filesystem::path &path, std::span<const Section> ranges);
+
+/**
+ * @brief Overwrite the given ranges of an existing file without truncating it
+ * @param data The data the ranges refer to, it must be identical to the file outside of the ranges
+ */
+void WriteRanges(std::filesystem::path path, std::span<u8> data, const std::vector<Section> &ranges);
+
+/**
+ * @brief A file that is written next to its destination and only renamed over it once it is complete, so a crash never leaves a partially written destination behind
+ * @note The temporary file is removed if the object is destroyed before commit()
+ */
+class AtomicFile {
+  private:
+    std::filesystem::path destination;
+    std::filesystem::path temporary;
+#if __has_include(<unistd.h>)
+    int fd{-1};
+#else
+    std::fstream file;
+#endif
+
+  public:
+    /**
+     * @throw exception If the temporary file could not be created
+     */
+    explicit AtomicFile(std::filesystem::path destination);
+
+    AtomicFile(const AtomicFile &) = delete;
+    AtomicFile &operator=(const AtomicFile &) = delete;
+
+    ~AtomicFile();
+
+    /**
+     * @brief Write data at the given offset of the temporary file, ranges may be written in any order
+     */
+    void write(std::span<const u8> data, size_t offset);
+
+    /**
+     * @brief Copy a range of another file to the given offset of the temporary file
+     * @note This uses copy_file_range where available, which lets filesystems with reflink support share the data instead of copying it
+     */
+    void copy(const std::filesystem::path &source, size_t sourceOffset, size_t size, size_t offset);
+
+    /**
+     * @brief Flush the temporary file to disk and replace the destination with it
+     */
+    void commit();
+};
+
+/**
+ * @brief Find every offset at which the two bytes of pair occur next to each other
+ * @note This uses the widest SIMD kernel the CPU supports, the offsets are in ascending order
+ */
+std::vector<u32> FindPairs(std::span<const u8> data, std::array<u8, 2> pair);
+
+/**
+ * @brief Find every range of bytes that differs between two buffers of the same size
+ * @return The ranges in ascending order, adjacent differing bytes are merged into a single range
+ * @note The buffers are compared in 4 KB blocks with the widest SIMD kernel the CPU supports, identical blocks are skipped after a single test
+ */
+std::vector<Section> FindDifferences(std::span<const u8> first, std::span<const u8> second);
+
 using Md5Hash = std::array<u8, MD5_DIGEST_LENGTH>;
 
+/**
+ * @brief A reusable MD5 context, hashing with it does not allocate after construction
+ */
+class Md5Hasher {
+  private:
+    EVP_MD_CTX *context;
+    EVP_MD *md5; //!< The fetched MD5 implementation, so it does not get looked up on every initialization
+
+  public:
+    Md5Hasher();
+
+    Md5Hasher(const Md5Hasher &) = delete;
+    Md5Hasher &operator=(const Md5Hasher &) = delete;
+
+    ~Md5Hasher();
+
+    /**
+     * @brief Append data to the message being hashed
+     */
+    Md5Hasher &update(std::span<const u8> input);
+
+    /**
+     * @brief Get the hash of all data passed to update(), this resets the hasher so it can be reused
+     */
+    Md5Hash finalize();
+};
+
 const Md5Hash GenerateMd5(std::span<u8> input);
 
-void Utf8ToUtf16(std::span<u8> chars, std::u16string_view text);
+/**
+ * @brief Hash multiple buffers at once
+ * @note If all buffers are the same size they are hashed in parallel SIMD lanes when the CPU supports it
+ */
+std::vector<Md5Hash> GenerateMd5(std::span<const std::span<u8>> inputs);
 
-const std::string Utf16ToUtf8String(std::span<u8> text);
+/**
+ * @brief The largest amount of bytes the UTF-8 conversion of a UTF-16 string of the given size can take up
+ */
+constexpr size_t Utf8Capacity(size_t utf16Size) {
+    return utf16Size / sizeof(char16_t) * 3;
+}
+
+/**
+ * @brief Convert a null-terminated little-endian UTF-16 string into a fixed buffer, unpaired surrogates are replaced with U+FFFD
+ * @param output A buffer of at least Utf8Capacity(text.size()) bytes
+ * @return The amount of bytes written, the conversion stops at the first null character
+ * @note Runs of ASCII characters are converted with SIMD where available
+ */
+size_t Utf16ToUtf8(std::span<const u8> text, std::span<char> output);
+
+/**
+ * @brief Convert UTF-8 into a fixed buffer of little-endian UTF-16, the rest of the buffer is zero filled to terminate the string
+ * @throw exception If the text is not valid UTF-8 or does not fit into the buffer together with a terminator
+ */
+void Utf8ToUtf16(std::string_view text, std::span<u8> output);
 
 const std::string SecondsToTimeStamp(const time_t seconds);
 
@@ -160,6 +435,12 @@ u64 GetSteamId(std::filesystem::path saveFilePath);
 
 Maybe<std::filesystem::path> FindFileInSubDirectory(std::filesystem::path directory, std::string_view filename);
 
+/**
+ * @brief Find every file with the given name in a directory tree, directories that cannot be read are skipped
+ * @return The paths in lexicographical order
+ */
+std::vector<std::filesystem::path> FindFilesInSubDirectories(std::filesystem::path directory, std::string_view filename);
+
 /**
  * @brief Get an std::filesystem::path's absolute path, used for logging
  */
@@ -170,14 +451,4 @@ const std::filesystem::path ToAbsolutePath(std::filesystem::path path);
  */
 std::filesystem::path CreateDataDirectory();
 
-/**
- * @brief The directory to write a backup of the save file to at runtime
- */
-std::filesystem::path CreateBackupDirectory();
-
-/**
- * @brief Copy the savefile to the backup directory
- */
-std::filesystem::path BackupSavefile(std::filesystem::path saveFilePath);
-
 } // namespace util